@@ -0,0 +1,34 @@
+#include "batch_solver.h"
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+
+// Usage: flow_batch [threads] [input file]
+// Without the input file the instances are read from the standard input
+int main(int argc, char const *argv[])
+{
+    int threads = argc > 1? std::atoi(argv[1]) : std::thread::hardware_concurrency();
+
+    std::ios::sync_with_stdio(false);
+    Batch_solver solver(threads);
+
+    try {
+        if (argc > 2){
+            std::ifstream in(argv[2]);
+            if (!in){
+                std::cerr << "Cannot open " << argv[2] << std::endl;
+                return 1;
+            }
+            solver.solve_stream(in, std::cout);
+        }
+        else{
+            solver.solve_stream(std::cin, std::cout);
+        }
+    } catch (const std::exception& error) {
+        std::cout.flush();
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
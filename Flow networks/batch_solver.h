@@ -0,0 +1,275 @@
+#ifndef __BATCH_SOLVER__
+#define __BATCH_SOLVER__
+
+#include "goldberg_flow.h"
+
+#include <istream>
+#include <ostream>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <exception>
+#include <stdexcept>
+#include <limits>
+
+struct Flow_instance {
+    int vertices;
+    int source;
+    int target;
+    // Triples from, to, capacity
+    std::vector<int> edges;
+};
+
+struct Flow_result {
+    int max_flow;
+    std::vector<Flow_edge> flow_edges;
+};
+
+/**
+ * Solves independent flow instances on a fixed pool of threads.
+ * Every thread owns one Goldberg_flow object which is reused for all its instances.
+ */
+class Batch_solver
+{
+public:
+    Batch_solver(int threads);
+    ~Batch_solver();
+
+    std::future<Flow_result> submit(Flow_instance instance);
+    void solve_stream(std::istream& in, std::ostream& out);
+
+    static bool read_instance(std::istream& in, Flow_instance& instance);
+    static bool valid_instance(const Flow_instance& instance);
+    static void write_result(std::ostream& out, const Flow_result& result);
+
+private:
+    struct Job {
+        Flow_instance instance;
+        std::promise<Flow_result> result;
+    };
+
+    std::vector<std::thread> m_threads;
+    std::deque<Job> m_jobs;
+    std::mutex m_mutex;
+    std::condition_variable m_wakeup;
+    bool m_stop;
+
+    void worker();
+};
+
+/**
+ * Start the worker threads
+ *
+ * @param  {int} threads : Number of worker threads
+ */
+Batch_solver::Batch_solver(int threads) : m_stop(false)
+{
+    if (threads < 1)
+        threads = 1;
+
+    for (int i = 0; i < threads; i++)
+        m_threads.emplace_back(&Batch_solver::worker, this);
+}
+
+/**
+ * Finish all submitted instances and stop the worker threads
+ *
+ */
+Batch_solver::~Batch_solver()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wakeup.notify_all();
+
+    for (auto& thread : m_threads)
+        thread.join();
+}
+
+/**
+ * Queue the instance for solving
+ *
+ * @param  {Flow_instance} instance    : Flow instance
+ * @return {std::future<Flow_result>}  : Result which is ready after the instance is solved
+ */
+std::future<Flow_result> Batch_solver::submit(Flow_instance instance)
+{
+    Job job;
+    job.instance = std::move(instance);
+    std::future<Flow_result> result = job.result.get_future();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.push_back(std::move(job));
+    }
+    m_wakeup.notify_one();
+
+    return result;
+}
+
+/**
+ * Read concatenated instances from the stream and write their results
+ * in the input order. Only a limited window of instances is kept in memory.
+ * A malformed instance ends the stream, its exception is rethrown after
+ * the results of the previous instances are written.
+ *
+ * @param  {std::istream} in  : Input stream
+ * @param  {std::ostream} out : Output stream
+ */
+void Batch_solver::solve_stream(std::istream& in, std::ostream& out)
+{
+    const size_t window = 4 * m_threads.size();
+    std::deque<std::future<Flow_result>> pending;
+    Flow_instance instance;
+
+    std::exception_ptr error;
+
+    while (true)
+    {
+        // Results before a malformed instance are still written
+        try {
+            if (!read_instance(in, instance))
+                break;
+        } catch (...) {
+            error = std::current_exception();
+            break;
+        }
+
+        pending.push_back(submit(std::move(instance)));
+        instance = Flow_instance();
+
+        if (pending.size() > window){
+            write_result(out, pending.front().get());
+            pending.pop_front();
+        }
+    }
+
+    while (!pending.empty())
+    {
+        write_result(out, pending.front().get());
+        pending.pop_front();
+    }
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+/**
+ * Read one instance in the format of the single instance solver:
+ * "vertices edges source target" followed by "from to capacity" for every edge.
+ * A malformed instance throws std::invalid_argument.
+ *
+ * @param  {std::istream} in          : Input stream
+ * @param  {Flow_instance} instance   : Read instance
+ * @return {bool}                     : False if there is no other instance
+ */
+bool Batch_solver::read_instance(std::istream& in, Flow_instance& instance)
+{
+    int edges;
+
+    if (!(in >> instance.vertices >> edges >> instance.source >> instance.target))
+        return false;
+
+    if (edges < 0 || edges > std::numeric_limits<int>::max() / 3)
+        throw std::invalid_argument("invalid number of edges of the flow instance");
+
+    instance.edges.resize(3 * edges);
+    for (int i = 0; i < 3 * edges; i++)
+        in >> instance.edges[i];
+
+    if (!in)
+        throw std::invalid_argument("truncated flow instance");
+    if (!valid_instance(instance))
+        throw std::invalid_argument("invalid flow instance");
+
+    return true;
+}
+
+/**
+ * Check the instance like the asserts of the solver, which are not compiled with NDEBUG:
+ * the source and the target are distinct vertices, the edges join distinct vertices
+ * and have positive capacities
+ *
+ * @param  {Flow_instance} instance   : Checked instance
+ * @return {bool}                     : True if the solver accepts the instance
+ */
+bool Batch_solver::valid_instance(const Flow_instance& instance)
+{
+    auto vertex = [&instance](int v){ return v >= 1 && v <= instance.vertices; };
+
+    if (instance.vertices < 2 || !vertex(instance.source) || !vertex(instance.target) || 
+        instance.source == instance.target || instance.edges.size() % 3 != 0)
+        return false;
+
+    for (size_t i = 0; i < instance.edges.size(); i += 3){
+        int from = instance.edges[i], to = instance.edges[i + 1], capacity = instance.edges[i + 2];
+        if (!vertex(from) || !vertex(to) || from == to || capacity <= 0)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Write the maximum flow, edges with positive flow and an empty separating line
+ *
+ * @param  {std::ostream} out        : Output stream
+ * @param  {Flow_result} result      : Solved instance
+ */
+void Batch_solver::write_result(std::ostream& out, const Flow_result& result)
+{
+    out << result.max_flow << '\n';
+
+    for (const auto& edge : result.flow_edges)
+        out << edge.from << ' ' << edge.to << ' ' << edge.flow << '\n';
+
+    out << '\n';
+}
+
+/**
+ * Take instances from the queue until the solver is stopped,
+ * an invalid instance or a failure of the solver is stored in its future
+ *
+ */
+void Batch_solver::worker()
+{
+    Goldberg_flow g;
+
+    while (true)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wakeup.wait(lock, [this]{ return m_stop || !m_jobs.empty(); });
+
+            if (m_jobs.empty())
+                return;
+
+            job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+        }
+
+        // Failures are passed to the future, the thread takes the next instance
+        try {
+            const Flow_instance& instance = job.instance;
+            if (!valid_instance(instance))
+                throw std::invalid_argument("invalid flow instance");
+
+            g.reset(instance.vertices, instance.source, instance.target);
+            g.add_edges(instance.edges);
+
+            Flow_result result;
+            result.max_flow = g.get_max_flow();
+            result.flow_edges = g.get_flow_edges();
+
+            job.result.set_value(std::move(result));
+        } catch (...) {
+            job.result.set_exception(std::current_exception());
+        }
+    }
+}
+
+#endif // __BATCH_SOLVER__
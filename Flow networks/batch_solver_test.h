@@ -0,0 +1,77 @@
+#ifndef __BATCH_SOLVER_TEST__
+#define __BATCH_SOLVER_TEST__
+
+#include "batch_solver.h"
+#include <cassert>
+#include <sstream>
+#include <stdexcept>
+
+class Batch_solver_tester
+{
+public:
+    void test_instances();
+};
+
+void Batch_solver_tester::test_instances() 
+{
+    Batch_solver solver(4);
+    std::vector<std::future<Flow_result>> results;
+    std::vector<int> expected;
+
+    for (int i = 0; i < 20; i++){
+        Flow_instance instance;
+        if (i % 2 == 0){
+            instance.vertices = 6; instance.source = 1; instance.target = 6;
+            instance.edges = {1, 2, 10,  1, 3, 13,  2, 3, 3,  3, 6, 7,  3, 4, 6,  4, 5, 10,  5, 6, 5};
+            expected.push_back(12);
+        } else {
+            instance.vertices = 4; instance.source = 1; instance.target = 4;
+            instance.edges = {3, 1, 17,  1, 2, 10,  1, 3, 5,  3, 2, 3,  2, 3, 1,  2, 4, 2,  3, 4, 7};
+            expected.push_back(8);
+        }
+        results.push_back(solver.submit(instance));
+    }
+
+    for (size_t i = 0; i < results.size(); i++){
+        Flow_result result = results[i].get();
+        assert(result.max_flow == expected[i]);
+
+        int into_target = 0;
+        int target = i % 2 == 0? 6 : 4;
+        for (const auto& edge : result.flow_edges)
+            if (edge.to == target)
+                into_target += edge.flow;
+        assert(into_target == expected[i]);
+    }
+
+    // Invalid instances fail their futures, the workers keep solving
+    Flow_instance invalid;
+    invalid.vertices = 3; invalid.source = 1; invalid.target = 3;
+    invalid.edges = {1, 2, 5,  2, 4, 5};
+    std::future<Flow_result> failed = solver.submit(invalid);
+    invalid.edges = {1, 2, 5,  2, 3, 4};
+    std::future<Flow_result> solved = solver.submit(invalid);
+
+    bool thrown = false;
+    try {
+        failed.get();
+    } catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    assert(thrown);
+    assert(solved.get().max_flow == 4);
+
+    // The results before a malformed instance are written
+    std::istringstream in("2 1 1 2\n1 2 7\n3 1 1 3\n1 3 0\n");
+    std::ostringstream out;
+    thrown = false;
+    try {
+        solver.solve_stream(in, out);
+    } catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    assert(thrown);
+    assert(out.str().compare(0, 2, "7\n") == 0);
+}
+
+#endif // __BATCH_SOLVER_TEST__
\ No newline at end of file
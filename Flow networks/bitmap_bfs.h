@@ -0,0 +1,228 @@
+#ifndef __BITMAP_BFS__
+#define __BITMAP_BFS__
+
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <algorithm>
+
+/**
+ * Direction optimizing breadth first search with the frontiers stored as bitmaps.
+ * Small frontiers are expanded top-down along the successors, large frontiers
+ * bottom-up: every unvisited vertex looks for a predecessor in the frontier
+ * and stops at the first one. Bitmaps are merged and scanned by whole 64-bit words,
+ * the bottom-up steps of large graphs are split between threads by ranges of words.
+ *
+ * The graph is any class with the methods
+ *   int size() const                                   : number of vertices
+ *   int degree(int v) const                            : number of arcs of the vertex
+ *   void for_each_successor(int v, Visit visit) const  : calls visit(w) for the arcs v -> w
+ *   bool any_predecessor(int v, Test test) const       : true if test(u) for some arc u -> v
+ */
+class Bitmap_bfs
+{
+public:
+    Bitmap_bfs(int threads = 1) : m_threads(std::max(threads, 1)) {}
+
+    void set_threads(int threads){m_threads = std::max(threads, 1);}
+
+    template <class Graph>
+    void search(const Graph& graph, const std::vector<int>& starts,
+                std::vector<int>& distance, int first_distance = 0);
+
+private:
+    typedef uint64_t Word;
+
+    // Switching of the directions by Beamer et al.,
+    // bottom-up steps are split when every thread gets enough words
+    enum { word_bits = 64, alpha = 14, beta = 24, parallel_words = 1024 };
+
+    struct Step {
+        long long vertices;
+        long long edges;
+    };
+
+    int m_threads;
+    std::vector<Word> m_visited, m_frontier, m_next;
+
+    static bool test(const std::vector<Word>& bitmap, int v){return bitmap[v / word_bits] >> (v % word_bits) & 1;}
+    static void set(std::vector<Word>& bitmap, int v){bitmap[v / word_bits] |= Word(1) << (v % word_bits);}
+
+    template <class Graph>
+    Step top_down(const Graph& graph, std::vector<int>& distance, int level);
+    template <class Graph>
+    Step bottom_up(const Graph& graph, std::vector<int>& distance, int level);
+    template <class Graph>
+    Step bottom_up_words(const Graph& graph, std::vector<int>& distance, int level, size_t first, size_t last);
+};
+
+/**
+ * Distances from the nearest start vertex. Vertices with non-negative distance
+ * are already visited and the search does not pass through them,
+ * unreached vertices keep the distance -1.
+ *
+ * @param  {Graph} graph               : Searched graph
+ * @param  {std::vector<int>} starts   : Start vertices, they get first_distance
+ * @param  {std::vector<int>} distance : Distances of vertices, -1 if not visited
+ * @param  {int} first_distance        : Distance of the start vertices
+ */
+template <class Graph>
+void Bitmap_bfs::search(const Graph& graph, const std::vector<int>& starts,
+                        std::vector<int>& distance, int first_distance)
+{
+    int n = graph.size();
+    size_t words = (n + word_bits - 1) / word_bits;
+
+    m_visited.assign(words, 0);
+    m_frontier.assign(words, 0);
+    m_next.assign(words, 0);
+
+    // Bits after the last vertex are visited, so the bottom-up steps skip them
+    if (n % word_bits)
+        m_visited.back() = ~Word(0) << (n % word_bits);
+
+    long long unexplored = 0;
+    for (int v = 0; v < n; v++){
+        if (distance[v] >= 0)
+            set(m_visited, v);
+        else
+            unexplored += graph.degree(v);
+    }
+
+    Step frontier = {0, 0};
+    for (int v : starts){
+        if (test(m_frontier, v))
+            continue;
+
+        if (!test(m_visited, v))
+            unexplored -= graph.degree(v);
+        set(m_visited, v);
+        set(m_frontier, v);
+        distance[v] = first_distance;
+        frontier.vertices++;
+        frontier.edges += graph.degree(v);
+    }
+
+    bool bottom = false;
+    for (int level = first_distance + 1; frontier.vertices > 0; level++)
+    {
+        if (!bottom && frontier.edges > unexplored / alpha)
+            bottom = true;
+        else if (bottom && frontier.vertices < n / beta)
+            bottom = false;
+
+        std::fill(m_next.begin(), m_next.end(), 0);
+        frontier = bottom? bottom_up(graph, distance, level) : top_down(graph, distance, level);
+        unexplored -= frontier.edges;
+
+        for (size_t i = 0; i < words; i++)
+            m_visited[i] |= m_next[i];
+        m_frontier.swap(m_next);
+    }
+}
+
+/**
+ * Visits the unvisited successors of the frontier
+ *
+ * @param  {Graph} graph               : Searched graph
+ * @param  {std::vector<int>} distance : Distances of vertices
+ * @param  {int} level                 : Distance of the next frontier
+ * @return {Step}                      : Vertices and arcs of the next frontier
+ */
+template <class Graph>
+Bitmap_bfs::Step Bitmap_bfs::top_down(const Graph& graph, std::vector<int>& distance, int level)
+{
+    Step next = {0, 0};
+
+    for (size_t i = 0; i < m_frontier.size(); i++){
+        for (Word word = m_frontier[i]; word; word &= word - 1){
+            int v = i * word_bits + __builtin_ctzll(word);
+
+            graph.for_each_successor(v, [&](int w){
+                if (test(m_visited, w))
+                    return;
+                set(m_visited, w);
+                set(m_next, w);
+                distance[w] = level;
+                next.vertices++;
+                next.edges += graph.degree(w);
+            });
+        }
+    }
+    return next;
+}
+
+/**
+ * Unvisited vertices with a predecessor in the frontier join the next frontier,
+ * the words are split between the threads
+ *
+ * @param  {Graph} graph               : Searched graph
+ * @param  {std::vector<int>} distance : Distances of vertices
+ * @param  {int} level                 : Distance of the next frontier
+ * @return {Step}                      : Vertices and arcs of the next frontier
+ */
+template <class Graph>
+Bitmap_bfs::Step Bitmap_bfs::bottom_up(const Graph& graph, std::vector<int>& distance, int level)
+{
+    size_t words = m_visited.size();
+    size_t threads = std::min<size_t>(m_threads, words / parallel_words);
+
+    if (threads <= 1)
+        return bottom_up_words(graph, distance, level, 0, words);
+
+    // Every thread writes only its own words of the next frontier
+    std::vector<Step> steps(threads);
+    std::vector<std::thread> workers;
+    size_t chunk = (words + threads - 1) / threads;
+
+    for (size_t t = 1; t < threads; t++){
+        workers.emplace_back([&, t]{
+            steps[t] = bottom_up_words(graph, distance, level, t * chunk, std::min(words, (t + 1) * chunk));
+        });
+    }
+    steps[0] = bottom_up_words(graph, distance, level, 0, chunk);
+
+    Step next = {0, 0};
+    for (size_t t = 0; t < threads; t++){
+        if (t > 0)
+            workers[t - 1].join();
+        next.vertices += steps[t].vertices;
+        next.edges += steps[t].edges;
+    }
+    return next;
+}
+
+/**
+ * Bottom-up step over the range of words
+ *
+ * @param  {Graph} graph               : Searched graph
+ * @param  {std::vector<int>} distance : Distances of vertices
+ * @param  {int} level                 : Distance of the next frontier
+ * @param  {size_t} first              : First word of the range
+ * @param  {size_t} last               : Word after the range
+ * @return {Step}                      : Vertices and arcs of the next frontier in the range
+ */
+template <class Graph>
+Bitmap_bfs::Step Bitmap_bfs::bottom_up_words(const Graph& graph, std::vector<int>& distance,
+                                             int level, size_t first, size_t last)
+{
+    Step next = {0, 0};
+    auto in_frontier = [this](int u){ return test(m_frontier, u); };
+
+    for (size_t i = first; i < last; i++){
+        for (Word word = ~m_visited[i]; word; word &= word - 1){
+            int bit = __builtin_ctzll(word);
+            int v = i * word_bits + bit;
+
+            if (graph.any_predecessor(v, in_frontier)){
+                m_next[i] |= Word(1) << bit;
+                distance[v] = level;
+                next.vertices++;
+                next.edges += graph.degree(v);
+            }
+        }
+    }
+    return next;
+}
+
+#endif // __BITMAP_BFS__
@@ -0,0 +1,108 @@
+#ifndef __BITMAP_BFS_TEST__
+#define __BITMAP_BFS_TEST__
+
+#include "bitmap_bfs.h"
+#include <cassert>
+#include <random>
+#include <vector>
+
+class Bitmap_bfs_tester
+{
+public:
+    void test_searches();
+
+private:
+    // Adjacency lists of a directed graph in both directions
+    struct List_graph {
+        std::vector<std::vector<int>> successors, predecessors;
+
+        int size()const{return successors.size();}
+        int degree(int v)const{return successors[v].size() + predecessors[v].size();}
+
+        template <class Visit>
+        void for_each_successor(int v, Visit visit) const
+        {
+            for (int w : successors[v])
+                visit(w);
+        }
+
+        template <class Test>
+        bool any_predecessor(int v, Test test) const
+        {
+            for (int u : predecessors[v])
+                if (test(u))
+                    return true;
+            return false;
+        }
+    };
+
+    List_graph random_graph(int vertices, int edges, unsigned seed) const;
+    std::vector<int> queue_search(const List_graph& graph, const std::vector<int>& starts,
+                                  std::vector<int> distance, int first_distance) const;
+};
+
+void Bitmap_bfs_tester::test_searches()
+{
+    // Sparse graphs stay top-down, dense graphs switch to bottom-up,
+    // the largest one is split between the threads
+    int sizes[][2] = {{1, 0}, {70, 100}, {1000, 30000}, {5000, 6000}, {300000, 3000000}};
+
+    for (auto& size : sizes){
+        List_graph graph = random_graph(size[0], size[1], size[0]);
+        std::vector<int> starts = {0, size[0] / 2, size[0] / 2};
+
+        // Some vertices are already visited
+        std::vector<int> distance(size[0], -1);
+        for (int v = 3; v < size[0]; v += 17)
+            distance[v] = 1000;
+
+        std::vector<int> expected = queue_search(graph, starts, distance, 5);
+        for (int threads : {1, 4}){
+            std::vector<int> result = distance;
+            Bitmap_bfs(threads).search(graph, starts, result, 5);
+            assert(result == expected);
+        }
+    }
+}
+
+Bitmap_bfs_tester::List_graph Bitmap_bfs_tester::random_graph(int vertices, int edges, unsigned seed) const
+{
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int> vertex(0, vertices - 1);
+    List_graph graph;
+
+    graph.successors.resize(vertices);
+    graph.predecessors.resize(vertices);
+    for (int i = 0; i < edges; i++){
+        int from = vertex(random), to = vertex(random);
+        graph.successors[from].push_back(to);
+        graph.predecessors[to].push_back(from);
+    }
+    return graph;
+}
+
+std::vector<int> Bitmap_bfs_tester::queue_search(const List_graph& graph, const std::vector<int>& starts,
+                                                 std::vector<int> distance, int first_distance) const
+{
+    std::vector<int> queue;
+    std::vector<bool> queued(graph.size(), false);
+
+    for (int v : starts){
+        if (!queued[v])
+            queue.push_back(v);
+        queued[v] = true;
+        distance[v] = first_distance;
+    }
+
+    for (size_t i = 0; i < queue.size(); i++){
+        for (int w : graph.successors[queue[i]]){
+            if (distance[w] == -1){
+                distance[w] = distance[queue[i]] + 1;
+                queue.push_back(w);
+            }
+        }
+    }
+    return distance;
+}
+
+#endif // __BITMAP_BFS_TEST__
@@ -0,0 +1,420 @@
+#ifndef __COMPACT_FLOW__
+#define __COMPACT_FLOW__
+
+#include "goldberg_flow.h"
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+/**
+ * Memory compact variant of the Goldberg's push-relabel algorithm for large graphs.
+ * Vertices and arcs are 32-bit indices, arcs of a vertex are stored consecutively
+ * and the state is kept in separate vectors (structure of arrays).
+ * Hot data per arc are the head, the residual capacity and the paired reverse arc (12 bytes),
+ * an undirected edge is one pair of arcs with the capacity in both directions,
+ * vertices have no containers, the active vertices are linked through the indices.
+ *
+ * Edges are collected by add_edge and the arrays are built by the first get_max_flow,
+ * duplicate edges are merged as in Goldberg_flow. Later calls solve the same graph again.
+ */
+class Compact_goldberg_flow
+{
+public:
+    Compact_goldberg_flow(int vertices, int source, int target);
+    ~Compact_goldberg_flow(){};
+
+    void add_edge(int from, int to, int capacity);
+    void add_undirected_edge(int u, int v, int capacity);
+    void add_edges(const std::vector<int>& edges);
+    int get_max_flow();
+    std::vector<Flow_edge> get_flow_edges() const;
+    int number_of_vertices()const{return m_vertices;}
+    int number_of_edges()const{return m_edge_arc.size();}
+
+private:
+    enum : uint32_t { none = UINT32_MAX };
+
+    uint32_t m_vertices;
+    uint32_t m_source, m_target;
+
+    // Added edges, released after the arcs are built
+    struct Input_edge {
+        uint32_t from;
+        uint32_t to;
+        int capacity;
+        int reverse_capacity;
+    };
+    std::vector<Input_edge> m_input;
+
+    // Arcs of the vertex v are m_first[v] .. m_first[v + 1] - 1
+    std::vector<uint32_t> m_first;
+    std::vector<uint32_t> m_head;
+    std::vector<int> m_residual;
+    std::vector<uint32_t> m_reverse;
+    // Forward arc of every added edge
+    std::vector<uint32_t> m_edge_arc;
+    // Initial residual of the reverse arcs, empty if all edges are directed
+    std::vector<int> m_edge_reverse_capacity;
+
+    // Vertex state
+    std::vector<int> m_height;
+    std::vector<int> m_excess;
+    std::vector<uint32_t> m_current;
+
+    // Active vertices in the lists by height
+    std::vector<uint32_t> m_bucket;
+    std::vector<uint32_t> m_next_active;
+    int m_max_active;
+
+    void merge_duplicates();
+    void build_arcs();
+    void reset_residuals();
+    void init();
+    void activate(uint32_t vertex);
+    void discharge(uint32_t vertex);
+    void relable(uint32_t vertex);
+};
+
+/**
+ * initialization constructor
+ *
+ * @param  {int} vertices : Number of vertices
+ * @param  {int} source   : Index of source vertex
+ * @param  {int} target   : Index of target vertex
+ */
+Compact_goldberg_flow::Compact_goldberg_flow(int vertices, int source, int target) :
+        m_vertices(vertices), m_source(source - 1), m_target(target - 1), m_max_active(-1)
+{
+}
+
+/**
+ * Add new edge from the vertex to another vertex
+ *
+ * @param  {int} from     : Index of the vertex where the edge starts from
+ * @param  {int} to       : Index of the vertex where the edge comes to
+ * @param  {int} capacity : Capacity of the edge
+ */
+void Compact_goldberg_flow::add_edge(int from, int to, int capacity)
+{
+    assert(m_first.empty() && from != to && capacity > 0);
+    assert(from >= 1 && from <= m_vertices && to >= 1 && to <= m_vertices);
+
+    Input_edge edge = {uint32_t(from - 1), uint32_t(to - 1), capacity, 0};
+    m_input.push_back(edge);
+}
+
+/**
+ * Add new undirected edge, both arcs of the pair get the capacity.
+ * If there is already an edge between the vertices, the capacity is added to it.
+ *
+ * @param  {int} u        : Index of the first vertex
+ * @param  {int} v        : Index of the second vertex
+ * @param  {int} capacity : Capacity in each direction
+ */
+void Compact_goldberg_flow::add_undirected_edge(int u, int v, int capacity)
+{
+    add_edge(u, v, capacity);
+    m_input.back().reverse_capacity = capacity;
+}
+
+/**
+ * Add many edges at once
+ *
+ * @param  {std::vector<int>} edges : Triples from, to, capacity
+ */
+void Compact_goldberg_flow::add_edges(const std::vector<int>& edges)
+{
+    m_input.reserve(m_input.size() + edges.size() / 3);
+
+    for (size_t i = 0; i + 2 < edges.size(); i += 3)
+        add_edge(edges[i], edges[i + 1], edges[i + 2]);
+}
+
+/**
+ * Find the maximum flow and returns it, 
+ * every call solves the graph from the zero flow
+ *
+ * @return {int}  : The maximum flow
+ */
+int Compact_goldberg_flow::get_max_flow()
+{
+    if (m_first.empty())
+        build_arcs();
+    else
+        reset_residuals();
+    init();
+
+    while (m_max_active >= 0)
+    {
+        uint32_t vertex = m_bucket[m_max_active];
+        if (vertex == none){
+            m_max_active--;
+            continue;
+        }
+
+        m_bucket[m_max_active] = m_next_active[vertex];
+        discharge(vertex);
+    }
+
+    return m_excess[m_target];
+}
+
+/**
+ * Edges with positive flow in the order they were added
+ *
+ * @return {std::vector<Flow_edge>}  : Edges with their flow
+ */
+std::vector<Flow_edge> Compact_goldberg_flow::get_flow_edges() const
+{
+    std::vector<Flow_edge> edges;
+
+    for (uint32_t i = 0; i < m_edge_arc.size(); i++){
+        uint32_t arc = m_edge_arc[i];
+        int from = m_head[m_reverse[arc]] + 1,
+            to = m_head[arc] + 1;
+
+        // Residual of the reverse arc is its capacity plus the flow
+        int flow = m_residual[m_reverse[arc]];
+        if (!m_edge_reverse_capacity.empty())
+            flow -= m_edge_reverse_capacity[i];
+
+        if (flow > 0)
+            edges.push_back({from, to, flow});
+        else if (flow < 0)
+            edges.push_back({to, from, -flow});
+    }
+    return edges;
+}
+
+/**
+ * Merges the edges between the same vertices as Goldberg_flow does. 
+ * A directed edge is ignored if the edge in its direction exists, 
+ * an undirected edge adds its capacity to the opposite edge, or to the edge
+ * in its direction if there is no opposite one. The first edge of every 
+ * direction stays on its position, the merged edges are dropped.
+ *
+ */
+void Compact_goldberg_flow::merge_duplicates()
+{
+    // Edges between the same vertices are consecutive, in the order they were added
+    std::vector<uint32_t> order(m_input.size());
+    for (uint32_t i = 0; i < order.size(); i++)
+        order[i] = i;
+
+    auto pair_key = [this](uint32_t i){
+        const Input_edge& edge = m_input[i];
+        return std::make_pair(std::min(edge.from, edge.to), std::max(edge.from, edge.to));
+    };
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b){
+        return std::make_pair(pair_key(a), a) < std::make_pair(pair_key(b), b);
+    });
+
+    std::vector<bool> merged(m_input.size(), false);
+    bool duplicates = false;
+    for (uint32_t begin = 0, end; begin < order.size(); begin = end){
+        // Edge from the lower vertex and from the higher vertex
+        uint32_t direction_edge[2] = {none, none};
+
+        for (end = begin; end < order.size() && pair_key(order[end]) == pair_key(order[begin]); end++){
+            uint32_t i = order[end];
+            Input_edge& edge = m_input[i];
+            int direction = edge.from < edge.to? 0 : 1;
+            uint32_t target = edge.reverse_capacity == 0 || direction_edge[1 - direction] == none? 
+                              direction_edge[direction] : direction_edge[1 - direction];
+
+            if (target == none){
+                direction_edge[direction] = i;
+                continue;
+            }
+
+            if (edge.reverse_capacity > 0){
+                m_input[target].capacity += edge.capacity;
+                m_input[target].reverse_capacity += edge.capacity;
+            }
+            merged[i] = duplicates = true;
+        }
+    }
+
+    if (!duplicates)
+        return;
+
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < m_input.size(); i++)
+        if (!merged[i])
+            m_input[kept++] = m_input[i];
+    m_input.resize(kept);
+}
+
+/**
+ * Sorts the arcs by their tails with the counting sort,
+ * every edge gives the forward arc and the reverse arc, 
+ * which has zero capacity unless the edge is undirected
+ *
+ */
+void Compact_goldberg_flow::build_arcs()
+{
+    merge_duplicates();
+
+    uint32_t arcs = 2 * m_input.size();
+
+    m_first.assign(m_vertices + 1, 0);
+    for (const auto& edge : m_input){
+        m_first[edge.from + 1]++;
+        m_first[edge.to + 1]++;
+    }
+    for (uint32_t v = 0; v < m_vertices; v++)
+        m_first[v + 1] += m_first[v];
+
+    m_head.resize(arcs);
+    m_residual.resize(arcs);
+    m_reverse.resize(arcs);
+    m_edge_arc.resize(m_input.size());
+
+    bool undirected = std::any_of(m_input.begin(), m_input.end(), 
+                                  [](const Input_edge& edge){ return edge.reverse_capacity > 0; });
+    m_edge_reverse_capacity.clear();
+    if (undirected)
+        for (const auto& edge : m_input)
+            m_edge_reverse_capacity.push_back(edge.reverse_capacity);
+
+    std::vector<uint32_t> next(m_first.begin(), m_first.end() - 1);
+    for (uint32_t i = 0; i < m_input.size(); i++){
+        const Input_edge& edge = m_input[i];
+        uint32_t forward = next[edge.from]++,
+                 backward = next[edge.to]++;
+
+        m_head[forward] = edge.to;
+        m_residual[forward] = edge.capacity;
+        m_reverse[forward] = backward;
+
+        m_head[backward] = edge.from;
+        m_residual[backward] = edge.reverse_capacity;
+        m_reverse[backward] = forward;
+
+        m_edge_arc[i] = forward;
+    }
+
+    std::vector<Input_edge>().swap(m_input);
+}
+
+/**
+ * Returns the flow of every edge to zero, the sum of the residuals 
+ * of the pair of arcs is the capacity of the edge in both directions
+ *
+ */
+void Compact_goldberg_flow::reset_residuals()
+{
+    for (uint32_t i = 0; i < m_edge_arc.size(); i++){
+        uint32_t forward = m_edge_arc[i],
+                 backward = m_reverse[forward];
+        int reverse_capacity = m_edge_reverse_capacity.empty()? 0 : m_edge_reverse_capacity[i];
+
+        m_residual[forward] += m_residual[backward] - reverse_capacity;
+        m_residual[backward] = reverse_capacity;
+    }
+}
+
+/**
+ * Sets the heights and saturates the edges from the source
+ *
+ */
+void Compact_goldberg_flow::init()
+{
+    m_height.assign(m_vertices, 0);
+    m_excess.assign(m_vertices, 0);
+    m_current.assign(m_first.begin(), m_first.end() - 1);
+    m_bucket.assign(2 * m_vertices + 1, none);
+    m_next_active.assign(m_vertices, none);
+    m_max_active = -1;
+
+    m_height[m_source] = m_vertices;
+
+    for (uint32_t arc = m_first[m_source]; arc < m_first[m_source + 1]; arc++){
+        int flow = m_residual[arc];
+        if (flow == 0)
+            continue;
+
+        uint32_t head = m_head[arc];
+        m_residual[arc] = 0;
+        m_residual[m_reverse[arc]] += flow;
+        m_excess[m_source] -= flow;
+        m_excess[head] += flow;
+
+        if (m_excess[head] == flow)
+            activate(head);
+    }
+}
+
+/**
+ * Inserts the vertex to the list of active vertices of its height
+ *
+ * @param  {uint32_t} vertex : Vertex with new excess flow
+ */
+void Compact_goldberg_flow::activate(uint32_t vertex)
+{
+    if (vertex == m_source || vertex == m_target)
+        return;
+
+    int h = m_height[vertex];
+    m_next_active[vertex] = m_bucket[h];
+    m_bucket[h] = vertex;
+
+    if (h > m_max_active)
+        m_max_active = h;
+}
+
+/**
+ * Pushes the excess flow along the admissible arcs and relabels the vertex
+ * until the vertex has no excess flow
+ *
+ * @param  {uint32_t} vertex : Active vertex
+ */
+void Compact_goldberg_flow::discharge(uint32_t vertex)
+{
+    const uint32_t last = m_first[vertex + 1];
+
+    while (m_excess[vertex] > 0)
+    {
+        uint32_t arc = m_current[vertex];
+        if (arc == last){
+            relable(vertex);
+            continue;
+        }
+
+        uint32_t head = m_head[arc];
+        if (m_residual[arc] > 0 && m_height[vertex] == m_height[head] + 1){
+            int flow = std::min(m_excess[vertex], m_residual[arc]);
+
+            m_residual[arc] -= flow;
+            m_residual[m_reverse[arc]] += flow;
+            m_excess[vertex] -= flow;
+            m_excess[head] += flow;
+
+            if (m_excess[head] == flow)
+                activate(head);
+        }
+        else
+            m_current[vertex]++;
+    }
+}
+
+/**
+ * Relabels vertex to one more than its lowest residual neighbour
+ *
+ * @param  {uint32_t} vertex : Vertex without admissible arc
+ */
+void Compact_goldberg_flow::relable(uint32_t vertex)
+{
+    int height = 2 * m_vertices;
+
+    for (uint32_t arc = m_first[vertex]; arc < m_first[vertex + 1]; arc++)
+        if (m_residual[arc] > 0)
+            height = std::min(height, m_height[m_head[arc]] + 1);
+
+    assert(height > m_height[vertex] && height <= 2 * m_vertices);
+    m_height[vertex] = height;
+    m_current[vertex] = m_first[vertex];
+}
+
+#endif // __COMPACT_FLOW__
@@ -0,0 +1,120 @@
+#ifndef __COMPACT_FLOW_TEST__
+#define __COMPACT_FLOW_TEST__
+
+#include "compact_flow.h"
+#include "goldberg_flow_test.h"
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+class Compact_flow_tester
+{
+public:
+    void test_graphs();
+    void test_random(int seed);
+};
+
+void Compact_flow_tester::test_graphs() 
+{
+    int edges[][3] = {{8, 4, 41}, {4, 8, 14}, {5, 9, 44}, {6, 10, 22}, {8, 9, 26}, {3, 2, 50}, 
+                      {6, 7, 9}, {9, 3, 1}, {3, 9, 42}, {2, 8, 3}, {8, 2, 34}, {4, 2, 36}, 
+                      {1, 7, 41}, {4, 1, 26}, {2, 7, 23}, {1, 4, 49}, {8, 10, 7}, {4, 6, 32}, 
+                      {1, 3, 47}, {5, 7, 45}, {6, 4, 29}, {7, 5, 47}, {1, 8, 22}, {2, 10, 29}, 
+                      {1, 9, 23}, {1, 10, 29}, {8, 3, 41}, {9, 10, 42}};
+
+    // Every vertex is once the target
+    for (int target = 2; target <= 10; target++){
+        Goldberg_flow g (10, 1, target);
+        Compact_goldberg_flow c (10, 1, target);
+        for (auto& e : edges){
+            g.add_edge(e[0], e[1], e[2]);
+            c.add_edge(e[0], e[1], e[2]);
+        }
+
+        int max_flow = c.get_max_flow();
+        assert(max_flow == g.get_max_flow());
+        assert(target != 10 || max_flow == 129);
+
+        int balance[11] = {};
+        for (const auto& edge : c.get_flow_edges()){
+            balance[edge.from] -= edge.flow;
+            balance[edge.to] += edge.flow;
+        }
+        for (int i = 2; i <= 10; i++)
+            assert(balance[i] == (i == target? max_flow : 0));
+
+        // The next call solves the same graph again
+        assert(c.get_max_flow() == max_flow);
+    }
+}
+
+/**
+ * Random graphs up to thousands of vertices with undirected edges and duplicates
+ * of the edges in both directions, checked against Goldberg_flow
+ *
+ * @param  {int} seed : Random seed
+ */
+void Compact_flow_tester::test_random(int seed)
+{
+    RandomGen random(seed);
+
+    for (int vertices : {10, 100, 1000, 2000, 4000}){
+        std::vector<int> edges = Golberg_flow_tester(seed).random_edges(vertices, (2 + std::log(vertices)) / vertices, 50);
+        Goldberg_flow g (vertices, 1, vertices);
+        Compact_goldberg_flow c (vertices, 1, vertices);
+
+        for (size_t i = 0; i < edges.size(); i += 3){
+            int from = edges[i], to = edges[i + 1], capacity = edges[i + 2];
+
+            // Every fourth edge is undirected, some edges are repeated or added in the opposite direction
+            switch (random.next_range(8)){
+            case 0:
+                g.add_undirected_edge(from, to, capacity);
+                c.add_undirected_edge(from, to, capacity);
+                break;
+            case 1:
+                g.add_undirected_edge(from, to, capacity);
+                c.add_undirected_edge(from, to, capacity);
+                g.add_undirected_edge(to, from, capacity + 1);
+                c.add_undirected_edge(to, from, capacity + 1);
+                break;
+            case 2:
+                g.add_edge(from, to, capacity);
+                c.add_edge(from, to, capacity);
+                g.add_edge(from, to, capacity + 7);
+                c.add_edge(from, to, capacity + 7);
+                break;
+            case 3:
+                g.add_edge(from, to, capacity);
+                c.add_edge(from, to, capacity);
+                g.add_undirected_edge(to, from, 3);
+                c.add_undirected_edge(to, from, 3);
+                g.add_edge(to, from, 5);
+                c.add_edge(to, from, 5);
+                break;
+            default:
+                g.add_edge(from, to, capacity);
+                c.add_edge(from, to, capacity);
+            }
+        }
+
+        int max_flow = g.get_max_flow();
+        assert(c.get_max_flow() == max_flow);
+        assert(c.number_of_edges() == g.number_of_edges());
+
+        // Flow is conserved and the edges respect their capacities in both directions
+        std::vector<long long> balance(vertices + 1, 0);
+        for (const auto& edge : c.get_flow_edges()){
+            assert(edge.flow > 0 && g.edge_exists(edge.from, edge.to));
+            balance[edge.from] -= edge.flow;
+            balance[edge.to] += edge.flow;
+        }
+        for (int v = 2; v < vertices; v++)
+            assert(balance[v] == 0);
+        assert(balance[vertices] == max_flow && balance[1] == -max_flow);
+
+        assert(c.get_max_flow() == max_flow);
+    }
+}
+
+#endif // __COMPACT_FLOW_TEST__
@@ -1,4 +1,7 @@
 #include "goldberg_flow_test.h"
+#include "batch_solver_test.h"
+#include "compact_flow_test.h"
+#include "bitmap_bfs_test.h"
 #include <deque>
 
 int main()
@@ -10,6 +13,20 @@ int main()
     t.simple_graph_1();
     t.simple_graph_2();
     t.simple_graph_3();
+    t.circulation_1();
+    t.circulation_2();
+    t.parametric_1();
+    t.reorder_1();
+    t.budget_1();
+    t.undirected_1();
+    t.generator_1();
+    t.checkpoint_1();
+    t.warm_start_1();
+    t.multi_terminal_1();
+    Batch_solver_tester().test_instances();
+    Compact_flow_tester().test_graphs();
+    Compact_flow_tester().test_random(41);
+    Bitmap_bfs_tester().test_searches();
     //t.random_graph(400, 10);
     t.test_random();
 
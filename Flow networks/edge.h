@@ -10,23 +10,33 @@ private:
     Vertex *m_start, *m_end;
     int m_flow;
     int m_capacity;
+    // Capacity from the end to the start, the flow can be negative down to -m_reverse_capacity.
+    // It is zero for directed edges and equal to m_capacity for undirected edges.
+    int m_reverse_capacity;
+    // Lower bound of the flow, it is not included in m_flow and m_capacity
+    int m_lower;
     std::list<Edge*>::iterator m_unsaturated_iterator;
+    // Index of the vertex which has the edge in its unsaturated list, -1 if none
     int m_unsaturated_placeID;
+    // Position in the list of the edges of the flow, the order of the checkpoint
+    int m_index;
 
 public:
     Edge() : m_start(nullptr), m_end(nullptr), m_flow(0), 
-            m_capacity(0), m_unsaturated_placeID(0) {}
-    Edge(Vertex *start, Vertex *end, int capacity) : 
+            m_capacity(0), m_reverse_capacity(0), m_lower(0), m_unsaturated_placeID(-1), m_index(-1) {}
+    Edge(Vertex *start, Vertex *end, int capacity, int lower = 0, int reverse_capacity = 0) : 
         m_start(start), m_end(end), m_flow(0), 
-        m_capacity(capacity), m_unsaturated_placeID(0) {}
+        m_capacity(capacity), m_reverse_capacity(reverse_capacity), m_lower(lower), m_unsaturated_placeID(-1), m_index(-1) {}
 
    Vertex* get_start() const {return m_start;}
    Vertex* get_end() const {return m_end;}
    bool is_outgoing(const Vertex* v) const { return m_start == v; }
    int get_flow(const Vertex* v) const {return is_outgoing(v)? m_flow : -m_flow; }
-   int get_residual(const Vertex* v) const {return is_outgoing(v)? m_capacity - m_flow : m_flow; }
+   int get_residual(const Vertex* v) const {return is_outgoing(v)? m_capacity - m_flow : m_flow + m_reverse_capacity; }
    Vertex* get_another_vertex(const Vertex* v) const {return v == m_start? m_end : m_start; }
    int get_capacity() const {return m_capacity;}
+   int get_reverse_capacity() const {return m_reverse_capacity;}
+   int get_lower() const {return m_lower;}
 };
 
 #endif // __EDGE__
\ No newline at end of file
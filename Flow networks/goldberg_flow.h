@@ -3,16 +3,61 @@
 
 #include "vertex.h"
 #include "edge.h"
+#include "bitmap_bfs.h"
 
 #include <functional>
 #include <utility>
 #include <algorithm>
 #include <cstdio>
+#include <cassert>
+#include <chrono>
+#include <atomic>
+#include <limits>
+#include <istream>
+#include <ostream>
+#include <cstdint>
+#include <cmath>
 
 //#define NDEBUG
 
+// Debug builds print every operation, FLOW_CHECK builds only check the invariants
+#if !defined(NDEBUG) && !defined(FLOW_CHECK)
+#define FLOW_TRACE
+#endif
+
 using edge_pair = std::pair<int, int>;
 
+struct Flow_edge {
+    int from;
+    int to;
+    int flow;
+};
+
+enum Vertex_order { BFS_FROM_TARGET, REVERSE_CUTHILL_MCKEE, DEGREE_SORTED };
+
+struct Parametric_cut {
+    // First integer lambda with this minimum cut
+    int lambda;
+    // Lambda where the capacity of this cut drops below the capacity of the previous cut
+    double breakpoint;
+    int max_flow;
+    // Vertices on the source side of the cut
+    std::vector<int> source_side;
+};
+
+enum Solve_status { SOLVED, TIMED_OUT, CANCELLED };
+
+struct Flow_progress {
+    // Flow which already reached the target, a lower bound of the maximum flow
+    int target_flow;
+    // Vertices with positive excess flow
+    int active_vertices;
+    // Height of the highest active vertex
+    int max_height;
+};
+
+using Clock = std::chrono::steady_clock;
+
 struct int_pair_hash {
     std::size_t operator () (const edge_pair &p) const {
         auto h = sizeof(size_t) * 8 / 2;
@@ -24,31 +69,65 @@ struct int_pair_hash {
 class Goldberg_flow
 {
 public:
+    Goldberg_flow() : m_source(nullptr), m_target(nullptr), m_height_excessflow(0), m_active_vertices(0), 
+                      m_initialized(false), m_check_interval(-1), m_check_counter(0), m_lambda(0) {}
     Goldberg_flow(int vertices, int source, int target);
+    Goldberg_flow(int vertices);
     ~Goldberg_flow(){};
     
+    void reset(int vertices, int source, int target);
     void add_edge(int from, int to, int capacity);
+    void add_edge(int from, int to, int lower, int upper);
+    void add_undirected_edge(int u, int v, int capacity);
+    void add_edges(const std::vector<int>& edges);
+    void set_supply(int vertex, int supply);
+    void add_source(int vertex, int limit = -1);
+    void add_target(int vertex, int limit = -1);
     int get_max_flow();
+    Solve_status solve(Clock::time_point deadline = Clock::time_point::max(), 
+                       const std::atomic<bool>* cancel = nullptr,
+                       const std::function<void(const Flow_progress&)>& progress = nullptr,
+                       int check_interval = 1024);
+    Flow_progress get_progress() const;
+    bool warm_start(const std::vector<Flow_edge>& flows);
+    void save_checkpoint(std::ostream& out) const;
+    bool load_checkpoint(std::istream& in);
+    bool get_circulation();
+    std::vector<int> get_violated_cut();
+    void add_parametric_edge(int from, int to, int capacity, int slope);
+    std::vector<Parametric_cut> get_parametric_cuts(const std::vector<int>& lambdas);
     int number_of_edges()const{return m_edges.size();}
     int number_of_vertices()const{return m_vertices.size() - 1;}
     bool edge_exists(int from, int to)const;
-    const std::vector<Edge*>& vertex_neighbours(int vertex) {return m_vertices[vertex].m_edges;}
+    const std::vector<Edge*>& vertex_neighbours(int vertex) {return m_vertices[internal_index(vertex)].m_edges;}
     void print_graph();
     void print_flow_edges();
-    int get_index(Vertex *v)const{return (v - &m_vertices[0]);}
+    std::vector<Flow_edge> get_flow_edges() const;
+    int get_index(const Vertex *v)const{return m_original.empty()? position(v) : m_original[position(v)];}
+    void reorder_vertices(Vertex_order order);
+    void set_check_interval(int operations){m_check_interval = operations;}
+    void set_search_threads(int threads){m_bfs.set_threads(threads);}
 
 #ifndef NDEBUG
     void test_height_diff();
     void test_excess_flow();
     void test_height_limit();
     void test_flow();
-    void test_edge(int from, int to, int capacity);
+    void test_edge(int from, int to, int lower, int upper);
+    void test_vertex(const Vertex* vertex);
+    void test_push(const Vertex* vertex, const Vertex* target, const Edge* edge);
+    void test_relabel(const Vertex* vertex);
+    void test_periodic();
 #else
     void test_height_diff(){}
     void test_excess_flow(){}
     void test_height_limit(){}
     void test_flow(){}
-    void test_edge(int from, int to, int capacity){}
+    void test_edge(int, int, int, int){}
+    void test_vertex(const Vertex*){}
+    void test_push(const Vertex*, const Vertex*, const Edge*){}
+    void test_relabel(const Vertex*){}
+    void test_periodic(){}
 #endif
 
 private:
@@ -56,16 +135,103 @@ private:
     Vertex *m_source, *m_target;
     std::vector<Vertex> m_vertices;
     std::unordered_map<edge_pair, Edge, int_pair_hash> m_edges;
+    // Edges in the order they were added, the order of the checkpoint
+    std::vector<Edge*> m_edge_list;
+    enum : int32_t { checkpoint_magic = 0x4b434647 };
     std::vector<std::list<Vertex*>> m_excessflow;
     int m_height_excessflow;
+    int m_active_vertices;
+    bool m_initialized;
+
+    // Full check of the invariants after this number of operations, 0 disables it.
+    // Negative value checks after V + E operations, so the checks cost as much as the operations.
+    int m_check_interval;
+    int m_check_counter;
+
+    // Edges with capacity + slope * lambda
+    struct Parametric_edge {
+        Edge* edge;
+        int capacity;
+        int slope;
+    };
+    std::vector<Parametric_edge> m_parametric;
+    // Lambda of the current preflow of the parametric flow
+    int m_lambda;
+
+    // Minimum cut at the lambda and the line of its capacity
+    struct Parametric_sample {
+        int lambda;
+        int max_flow;
+        long long constant, slope;
+        std::vector<bool> sink_side;
+    };
+
+    // Searches of the residual graph from the sinks, arcs go against the residual edges
+    struct Residual_graph {
+        const Goldberg_flow& flow;
+
+        int size()const{return flow.m_vertices.size();}
+        int degree(int v)const{return flow.m_vertices[v].m_edges.size();}
+
+        template <class Visit>
+        void for_each_successor(int v, Visit visit) const
+        {
+            const Vertex* vertex = &flow.m_vertices[v];
+            for (auto edge : vertex->m_edges){
+                const Vertex* another_vertex = edge->get_another_vertex(vertex);
+                if (edge->get_residual(another_vertex) > 0)
+                    visit(flow.position(another_vertex));
+            }
+        }
+
+        template <class Test>
+        bool any_predecessor(int v, Test test) const
+        {
+            const Vertex* vertex = &flow.m_vertices[v];
+            for (auto edge : vertex->m_edges)
+                if (edge->get_residual(vertex) > 0 && test(flow.position(edge->get_another_vertex(vertex))))
+                    return true;
+            return false;
+        }
+    };
+    Bitmap_bfs m_bfs;
+
+    // Original index of the vertex on the given position and the inverse, 
+    // both are empty if the vertices were not reordered
+    std::vector<int> m_original;
+    std::vector<int> m_position;
 
     // Methods
+    int position(const Vertex *v)const{return (v - &m_vertices[0]);}
+    int internal_index(int index)const{return m_position.empty()? index : m_position[index];}
+    Edge* insert_edge(int from, int to, int lower, int upper);
     void init();
+    void set_exact_heights();
+    void discharge();
+    bool discharge(int operations);
+    int top_height()const{return m_vertices.size() + 1;}
+    int target_flow()const;
     Vertex* get_max_excess_flow_vertex();
     Edge* get_positive_residual_edge(Vertex* vertex);
     void push (Vertex* vertex, Edge* edge);
     void relable (Vertex* vertex);
 
+    // Implicit super source and super sink
+    void absorb_demand(Vertex* vertex);
+    bool return_supply(Vertex* vertex);
+    void mark_sink_side(std::vector<bool>& sink_side);
+
+    // Parametric flow
+    void set_parametric_capacity(const Parametric_edge& p_edge, int lambda);
+    Parametric_sample parametric_sample(int lambda);
+    void search_breakpoints(int low, Parametric_sample& high, std::vector<Parametric_sample>& samples);
+    void restart();
+    void cut_line(const std::vector<bool>& sink_side, long long& constant, long long& slope);
+    std::vector<int> source_side(const std::vector<bool>& sink_side, bool side = false);
+
+    // Locality
+    void bfs_order(std::vector<int>& order, Vertex* start, bool by_degree);
+
     // Debug
     void print_excessflow(int height);
     void print_unsaturated(Vertex* vertex);
@@ -87,8 +253,52 @@ private:
  * @param  {int} target   : Index of target vertex
  */
 Goldberg_flow::Goldberg_flow(int vertices, int source, int target) : 
-        m_vertices(vertices), m_excessflow(2 * vertices), m_height_excessflow(0)
+        m_vertices(vertices), m_excessflow(2 * (vertices + 2)), m_height_excessflow(0), 
+        m_active_vertices(0), m_initialized(false), m_check_interval(-1), m_check_counter(0), m_lambda(0)
+{
+    m_source = &m_vertices[source - 1];
+    m_target = &m_vertices[target - 1];
+}
+
+/**
+ * Constructor for the circulation problem and the multi-terminal flow (without source and target)
+ * 
+ * @param  {int} vertices : Number of vertices
+ */
+Goldberg_flow::Goldberg_flow(int vertices) : 
+        m_source(nullptr), m_target(nullptr), m_vertices(vertices), 
+        m_excessflow(2 * (vertices + 2)), m_height_excessflow(0), m_active_vertices(0), 
+        m_initialized(false), m_check_interval(-1), m_check_counter(0), m_lambda(0)
+{
+}
+
+/**
+ * Prepare the object for a new graph. 
+ * Allocated memory (vertices, edge buckets, lists) is kept and reused.
+ * 
+ * @param  {int} vertices : Number of vertices
+ * @param  {int} source   : Index of source vertex
+ * @param  {int} target   : Index of target vertex
+ */
+void Goldberg_flow::reset(int vertices, int source, int target) 
 {
+    m_edges.clear();
+    m_edge_list.clear();
+    m_parametric.clear();
+    m_original.clear();
+    m_position.clear();
+
+    for (auto& vertex : m_vertices)
+        vertex.clear();
+    m_vertices.resize(vertices);
+
+    for (auto& list : m_excessflow)
+        list.clear();
+    m_excessflow.resize(2 * (vertices + 2));
+    m_height_excessflow = 0;
+    m_active_vertices = 0;
+    m_initialized = false;
+
     m_source = &m_vertices[source - 1];
     m_target = &m_vertices[target - 1];
 }
@@ -102,53 +312,601 @@ Goldberg_flow::Goldberg_flow(int vertices, int source, int target) :
  */
 void Goldberg_flow::add_edge(int from, int to, int capacity) 
 {
-    auto edge = std::make_pair(from, to);
-    from -= 1;
-    to -= 1;
+    add_edge(from, to, 0, capacity);
+}
 
+/**
+ * Add many edges at once. The storage of the edges and the adjacency lists 
+ * is allocated once before the edges are inserted.
+ * 
+ * @param  {std::vector<int>} edges : Triples from, to, capacity
+ */
+void Goldberg_flow::add_edges(const std::vector<int>& edges) 
+{
+    std::vector<int> degree(m_vertices.size(), 0);
+    for (size_t i = 0; i + 2 < edges.size(); i += 3){
+        degree[internal_index(edges[i] - 1)]++;
+        degree[internal_index(edges[i + 1] - 1)]++;
+    }
+
+    for (size_t v = 0; v < m_vertices.size(); v++)
+        m_vertices[v].m_edges.reserve(m_vertices[v].m_edges.size() + degree[v]);
+    m_edges.reserve(m_edges.size() + edges.size() / 3);
+
+    for (size_t i = 0; i + 2 < edges.size(); i += 3)
+        add_edge(edges[i], edges[i + 1], edges[i + 2]);
+}
+
+/**
+ * Add new edge with the lower bound of the flow.
+ * Lower bounds are satisfied by get_circulation().
+ * 
+ * @param  {int} from     : Index of the vertex where the edge starts from
+ * @param  {int} to       : Index of the vertex where the edge comes to
+ * @param  {int} lower    : Minimal flow along the edge
+ * @param  {int} upper    : Capacity of the edge
+ */
+void Goldberg_flow::add_edge(int from, int to, int lower, int upper) 
+{
 #ifndef NDEBUG
-    test_edge(from, to, capacity);
+    test_edge(from - 1, to - 1, lower, upper);
 #endif
 
-    if (m_edges.find(edge) != m_edges.end())
-        return;
+    insert_edge(from, to, lower, upper);
+}
 
-    m_edges[edge] = Edge(&m_vertices[from], &m_vertices[to], capacity);
-    
-    m_vertices[from].m_edges.push_back(&m_edges[edge]);
-    m_vertices[to].m_edges.push_back(&m_edges[edge]);
+/**
+ * Add new undirected edge, the flow can go in both directions up to the capacity.
+ * It is stored as one edge with the capacity in both directions. 
+ * If there is already an edge between the vertices, the capacity is added to it.
+ * 
+ * @param  {int} u        : Index of the first vertex
+ * @param  {int} v        : Index of the second vertex
+ * @param  {int} capacity : Capacity in each direction
+ */
+void Goldberg_flow::add_undirected_edge(int u, int v, int capacity) 
+{
+    test_edge(u - 1, v - 1, 0, capacity);
+
+    auto found = m_edges.find(std::make_pair(v, u));
+    Edge* edge = found != m_edges.end()? &found->second : insert_edge(u, v, 0, 0);
+
+    assert(edge->m_lower == 0 && !m_initialized);
+    edge->m_capacity += capacity;
+    edge->m_reverse_capacity += capacity;
 }
 
 /**
- * Find the maximum flow and returns it
+ * Add new edge with the capacity linear in the parameter lambda.
+ * The edge has to start in the source with non-negative slope or 
+ * end in the target with non-positive slope.
+ * 
+ * @param  {int} from     : Index of the vertex where the edge starts from
+ * @param  {int} to       : Index of the vertex where the edge comes to
+ * @param  {int} capacity : Capacity for the lambda 0
+ * @param  {int} slope    : Increase of the capacity per unit of lambda
+ */
+void Goldberg_flow::add_parametric_edge(int from, int to, int capacity, int slope) 
+{
+    Edge* edge = insert_edge(from, to, 0, 0);
+
+    assert((edge->m_start == m_source && slope >= 0) || (edge->m_end == m_target && slope <= 0));
+    m_parametric.push_back({edge, capacity, slope});
+}
+
+/**
+ * Computes minimum cuts for all integer lambdas from the first to the last given lambda.
+ * The preflow and heights of the previous lambda are reused, so the pushes and 
+ * relabels of the sweep over the given lambdas cost as much as one computation of the maximum flow,
+ * plus one search of the residual graph per lambda to find the cut.
+ * Cuts are nested, only the lambdas where the cut changes are returned.
+ * If the cut changes between two given lambdas, the cuts in between are found 
+ * by the breakpoint search of Gallo, Grigoriadis and Tarjan, which solves the flow 
+ * where the capacity lines of the two cuts cross, so a few solves find every breakpoint.
+ * The flow of the last lambda is left in the graph.
+ * 
+ * @param  {std::vector<int>} lambdas       : Increasing lambdas
+ * @return {std::vector<Parametric_cut>}    : Changes of the minimum cut
+ */
+std::vector<Parametric_cut> Goldberg_flow::get_parametric_cuts(const std::vector<int>& lambdas) 
+{
+    std::vector<Parametric_cut> cuts;
+    std::vector<Parametric_sample> samples;
+
+    if (m_initialized)
+        restart();
+
+    for (int i = 0; i < lambdas.size(); i++)
+    {
+        assert(i == 0 || lambdas[i - 1] < lambdas[i]);
+
+        Parametric_sample sample = parametric_sample(lambdas[i]);
+        if (i > 0 && sample.sink_side == samples.back().sink_side)
+            continue;
+
+        if (i > 0)
+            search_breakpoints(lambdas[i - 1], sample, samples);
+        samples.push_back(std::move(sample));
+    }
+
+    if (!lambdas.empty() && m_lambda != lambdas.back())
+        parametric_sample(lambdas.back());
+
+    for (int i = 0; i < samples.size(); i++)
+    {
+        const Parametric_sample& sample = samples[i];
+
+        Parametric_cut cut;
+        cut.lambda = sample.lambda;
+        cut.breakpoint = i == 0 || sample.slope == samples[i - 1].slope? sample.lambda : 
+                        double(samples[i - 1].constant - sample.constant) / (sample.slope - samples[i - 1].slope);
+        cut.max_flow = sample.max_flow;
+        cut.source_side = source_side(sample.sink_side);
+        cuts.push_back(cut);
+    }
+
+    return cuts;
+}
+
+/**
+ * Set supply of the vertex for the circulation problem
+ * 
+ * @param  {int} vertex : Index of the vertex
+ * @param  {int} supply : Supply of the vertex, negative value is a demand
+ */
+void Goldberg_flow::set_supply(int vertex, int supply) 
+{
+    m_vertices[internal_index(vertex - 1)].m_balance = supply;
+}
+
+/**
+ * Add the vertex to the sources of the multi-terminal flow. 
+ * Sources are supplied by the implicit super source, so no vertices or edges are added.
+ * 
+ * @param  {int} vertex : Index of the vertex
+ * @param  {int} limit  : Maximal flow leaving the vertex, -1 if it is not limited
+ */
+void Goldberg_flow::add_source(int vertex, int limit) 
+{
+    Vertex& v = m_vertices[internal_index(vertex - 1)];
+    assert(limit != 0 && v.m_target_limit == 0 && &v != m_source && &v != m_target);
+    v.m_source_limit = limit;
+}
+
+/**
+ * Add the vertex to the targets of the multi-terminal flow, 
+ * targets drain to the implicit super sink
+ * 
+ * @param  {int} vertex : Index of the vertex
+ * @param  {int} limit  : Maximal flow coming to the vertex, -1 if it is not limited
+ */
+void Goldberg_flow::add_target(int vertex, int limit) 
+{
+    Vertex& v = m_vertices[internal_index(vertex - 1)];
+    assert(limit != 0 && v.m_source_limit == 0 && &v != m_source && &v != m_target);
+    v.m_target_limit = limit;
+}
+
+/**
+ * Find the maximum flow and returns it, 
+ * the solving continues from the loaded checkpoint
  * 
  * @return {int}  : The possible maximum flow
  */
 int Goldberg_flow::get_max_flow() 
 {
-    init();
-    Vertex* vertex = get_max_excess_flow_vertex();
-    Edge* edge;  
+    // Loaded checkpoint is already initialized
+    if (!m_initialized)
+        init();
+    discharge();
 
-    while (vertex != nullptr && vertex->m_excess_flow > 0)
+    int max_flow = target_flow();
+
+#ifdef FLOW_TRACE
+    std::printf("finish, max flow %d\n", max_flow);
+#endif
+
+    return max_flow;
+}
+
+/**
+ * Find the maximum flow until the deadline or the cancellation.
+ * The deadline and the token are checked after every check_interval pushes and relabels.
+ * If the solving is stopped, the flow at the target is a lower bound of the maximum flow 
+ * and the next call continues from the stopped state.
+ * 
+ * @param  {Clock::time_point} deadline   : Time when the solving stops
+ * @param  {std::atomic<bool>*} cancel    : Solving stops when the token is set, can be null
+ * @param  {std::function} progress       : Called after every check_interval operations, can be null
+ * @param  {int} check_interval           : Number of operations between the checks, at least 1
+ * @return {Solve_status}                 : SOLVED if the maximum flow was found
+ */
+Solve_status Goldberg_flow::solve(Clock::time_point deadline, const std::atomic<bool>* cancel,
+                                  const std::function<void(const Flow_progress&)>& progress, int check_interval) 
+{
+    // Without an operation between the checks the solving would not advance
+    check_interval = std::max(check_interval, 1);
+
+    if (!m_initialized)
+        init();
+
+    while (!discharge(check_interval))
     {
-        edge = get_positive_residual_edge(vertex);       
+        if (progress)
+            progress(get_progress());
 
-        if (edge != nullptr)
-            push(vertex, edge);
+        if (cancel && cancel->load(std::memory_order_relaxed))
+            return CANCELLED;
+        if (Clock::now() >= deadline)
+            return TIMED_OUT;
+    }
+
+    if (progress)
+        progress(get_progress());
+
+    return SOLVED;
+}
+
+/**
+ * Current state of the solving
+ * 
+ * @return {Flow_progress}  : Flow at the target, active vertices and the highest active height
+ */
+Flow_progress Goldberg_flow::get_progress() const
+{
+    Flow_progress progress;
+    progress.target_flow = target_flow();
+    progress.active_vertices = m_active_vertices;
+    progress.max_height = m_height_excessflow;
+    return progress;
+}
+
+/**
+ * Start the solving from the given flow instead of the zero flow.
+ * The flow is checked against the capacities and the conservation in one pass,
+ * the heights are set to the exact distances in the residual graph and only edges 
+ * from the source to vertices which can still reach the target are saturated.
+ * If the flow is maximal, get_max_flow() has nothing to do.
+ * Lower bounds and supplies of vertices are not supported.
+ * 
+ * @param  {std::vector<Flow_edge>} flows : Flows of edges, e.g. from get_flow_edges()
+ * @return {bool}                         : False if the flow is not valid, the state is not changed
+ */
+bool Goldberg_flow::warm_start(const std::vector<Flow_edge>& flows) 
+{
+    assert(m_source && !m_initialized);
+
+    std::unordered_map<Edge*, int> edge_flow;
+    std::vector<long long> balance(m_vertices.size(), 0);
+
+    for (const auto& record : flows){
+        int vertices = m_vertices.size();
+        if (record.from < 1 || record.from > vertices || record.to < 1 || record.to > vertices)
+            return false;
+
+        // Undirected edge can be stored in the opposite direction
+        auto found = m_edges.find(std::make_pair(record.from, record.to));
+        int flow = record.flow;
+        if (found == m_edges.end()){
+            found = m_edges.find(std::make_pair(record.to, record.from));
+            if (found == m_edges.end() || found->second.m_reverse_capacity == 0)
+                return false;
+            flow = -flow;
+        }
+
+        Edge* edge = &found->second;
+        if (edge->m_lower != 0)
+            return false;
+
+        edge_flow[edge] += flow;
+        balance[position(edge->m_start)] -= flow;
+        balance[position(edge->m_end)] += flow;
+    }
+
+    for (const auto& e : edge_flow)
+        if (e.second > e.first->m_capacity || e.second < -e.first->m_reverse_capacity)
+            return false;
+
+    for (size_t v = 0; v < m_vertices.size(); v++){
+        const Vertex& vertex = m_vertices[v];
+        if (vertex.m_balance != 0 || (balance[v] != 0 && &vertex != m_source && &vertex != m_target))
+            return false;
+    }
+
+    for (const auto& e : edge_flow)
+        e.first->m_flow = e.second;
+    for (size_t v = 0; v < m_vertices.size(); v++)
+        m_vertices[v].m_excess_flow = balance[v];
+
+    m_initialized = true;
+    set_exact_heights();
+
+    // Edges from the source to vertices below the source would break the heights
+    for (auto edge : m_source->m_edges){
+        Vertex* another_vertex = edge->get_another_vertex(m_source);
+        int flow = edge->get_residual(m_source);
+
+        if (flow > 0 && another_vertex->m_height < m_source->m_height - 1){
+            edge->m_flow += edge->is_outgoing(m_source)? flow : -flow;
+            another_vertex->m_excess_flow += flow; 
+            m_source->m_excess_flow -= flow; 
+        }
+    }
+
+    // Edges go to the list of the higher vertex if they are admissible
+    for (Edge* edge : m_edge_list){
+        if (edge->m_start->m_height > edge->m_end->m_height)
+            fix_unsaturated(edge, edge->m_start);
         else
-            relable(vertex);
+            fix_unsaturated(edge, edge->m_end);
+    }
 
-        vertex = get_max_excess_flow_vertex();
+    for (auto& vertex : m_vertices)
+        fix_excessflow(&vertex);
+
+    test_excess_flow();
+    test_flow();
+    test_height_diff();
+    test_height_limit();
+    return true;
+}
+
+/**
+ * Write the state of the solving to the binary checkpoint. The checkpoint contains 
+ * capacities and flows of the edges, state of the vertices and the lists of the active 
+ * vertices and the unsaturated edges as flat arrays of 32-bit integers in the native byte order.
+ * 
+ * @param  {std::ostream} out : Binary output stream
+ */
+void Goldberg_flow::save_checkpoint(std::ostream& out) const
+{
+    std::vector<int32_t> data = {checkpoint_magic, int32_t(m_vertices.size()), int32_t(m_edge_list.size()), 
+                                 int32_t(m_excessflow.size()), m_initialized, m_height_excessflow};
+
+    for (const Edge* edge : m_edge_list){
+        data.push_back(edge->m_capacity);
+        data.push_back(edge->m_flow);
     }
 
-    int max_flow = m_target->m_excess_flow;
+    for (const Vertex& vertex : m_vertices){
+        int32_t state[] = {vertex.m_height, vertex.m_excess_flow, vertex.m_supply, 
+                           vertex.m_supply_flow, vertex.m_demand, vertex.m_demand_flow};
+        data.insert(data.end(), state, state + 6);
+    }
 
-#ifndef NDEBUG
-    std::printf("finish, max flow %d\n", max_flow);
+    for (const auto& list : m_excessflow){
+        data.push_back(list.size());
+        for (const Vertex* vertex : list)
+            data.push_back(position(vertex));
+    }
+
+    for (const Vertex& vertex : m_vertices){
+        data.push_back(vertex.m_unsaturated.size());
+        for (const Edge* edge : vertex.m_unsaturated)
+            data.push_back(edge->m_index);
+    }
+
+    out.write(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(int32_t));
+}
+
+/**
+ * Restore the state of the solving from the checkpoint. 
+ * The graph has to be built in the same way as the graph which wrote the checkpoint,
+ * get_max_flow() then continues exactly as the interrupted solving.
+ * The whole checkpoint is read and checked before the state is changed, 
+ * flows have to respect the capacities and the excess of every vertex has to match its flows.
+ * 
+ * @param  {std::istream} in  : Binary input stream
+ * @return {bool}             : False if the checkpoint does not match the graph, the state is not changed
+ */
+bool Goldberg_flow::load_checkpoint(std::istream& in)
+{
+    int32_t vertices = m_vertices.size(), edges = m_edge_list.size(), heights = m_excessflow.size();
+
+    auto read = [&in](std::vector<int32_t>& data, int32_t count){
+        if (count < 0)
+            return false;
+        data.resize(count);
+        in.read(reinterpret_cast<char*>(data.data()), count * sizeof(int32_t));
+        return bool(in);
+    };
+
+    // Lists are stored as the length and the items, every item is an index below the limit
+    std::vector<int32_t> data;
+    auto read_lists = [&](std::vector<std::vector<int32_t>>& lists, int32_t limit){
+        for (auto& list : lists){
+            if (!read(data, 1) || data[0] > limit || !read(list, data[0]))
+                return false;
+            for (int32_t item : list)
+                if (item < 0 || item >= limit)
+                    return false;
+        }
+        return true;
+    };
+
+    std::vector<int32_t> header, state;
+    if (!read(header, 6) || header[0] != checkpoint_magic || header[1] != vertices || 
+        header[2] != edges || header[3] != heights || (header[4] != 0 && header[4] != 1) || 
+        header[5] < 0 || header[5] >= heights)
+        return false;
+
+    std::vector<std::vector<int32_t>> excessflow(heights), unsaturated(vertices);
+    if (!read(state, 2 * edges + 6 * vertices) || !read_lists(excessflow, vertices) || !read_lists(unsaturated, edges))
+        return false;
+
+    const int32_t* edge_state = state.data();
+    const int32_t* vertex_state = edge_state + 2 * edges;
+
+    // Flows respect the capacities and the excesses are the balances of the flows
+    std::vector<long long> balance(vertices, 0);
+    for (int32_t e = 0; e < edges; e++){
+        const Edge* edge = m_edge_list[e];
+        int32_t capacity = edge_state[2 * e], flow = edge_state[2 * e + 1];
+        if (capacity < 0 || flow > capacity || flow < -edge->m_reverse_capacity)
+            return false;
+
+        balance[position(edge->m_start)] -= flow;
+        balance[position(edge->m_end)] += flow;
+    }
+
+    for (int32_t v = 0; v < vertices; v++){
+        const int32_t* value = vertex_state + 6 * v;
+        int32_t height = value[0], excess = value[1], supply = value[2], 
+                supply_flow = value[3], demand = value[4], demand_flow = value[5];
+
+        if (height < 0 || height >= heights || supply_flow < 0 || supply_flow > supply || 
+            demand_flow < 0 || demand_flow > demand || excess != balance[v] + supply_flow - demand_flow ||
+            (excess < 0 && &m_vertices[v] != m_source))
+            return false;
+    }
+
+    // Active vertices are listed once at their heights, edges once at one of their ends
+    std::vector<bool> listed(std::max(vertices, edges), false);
+    for (int32_t h = 0; h < heights; h++)
+        for (int32_t v : excessflow[h]){
+            const Vertex* vertex = &m_vertices[v];
+            if (listed[v] || vertex == m_source || vertex == m_target || 
+                vertex_state[6 * v] != h || vertex_state[6 * v + 1] <= 0)
+                return false;
+            listed[v] = true;
+        }
+
+    std::fill(listed.begin(), listed.end(), false);
+    for (int32_t v = 0; v < vertices; v++)
+        for (int32_t e : unsaturated[v]){
+            const Edge* edge = m_edge_list[e];
+            if (listed[e] || (position(edge->m_start) != v && position(edge->m_end) != v))
+                return false;
+            listed[e] = true;
+        }
+
+    // The checkpoint is valid, the state is replaced
+    for (Edge* edge : m_edge_list){
+        edge->m_capacity = *edge_state++;
+        edge->m_flow = *edge_state++;
+        edge->m_unsaturated_placeID = -1;
+    }
+
+    for (Vertex& vertex : m_vertices){
+        vertex.m_height = *vertex_state++;
+        vertex.m_excess_flow = *vertex_state++;
+        vertex.m_supply = *vertex_state++;
+        vertex.m_supply_flow = *vertex_state++;
+        vertex.m_demand = *vertex_state++;
+        vertex.m_demand_flow = *vertex_state++;
+        vertex.m_excessflow_inserted = false;
+        vertex.m_unsaturated.clear();
+    }
+
+    m_active_vertices = 0;
+    for (int32_t h = 0; h < heights; h++){
+        auto& list = m_excessflow[h];
+        list.clear();
+        for (int32_t v : excessflow[h]){
+            Vertex* vertex = &m_vertices[v];
+            vertex->m_excessflow_iterator = list.insert(list.end(), vertex);
+            vertex->m_excessflow_inserted = true;
+            m_active_vertices++;
+        }
+    }
+
+    for (int32_t v = 0; v < vertices; v++){
+        Vertex& vertex = m_vertices[v];
+        for (int32_t e : unsaturated[v]){
+            Edge* edge = m_edge_list[e];
+            edge->m_unsaturated_iterator = vertex.m_unsaturated.insert(vertex.m_unsaturated.end(), edge);
+            edge->m_unsaturated_placeID = v;
+        }
+    }
+
+    m_initialized = header[4];
+    m_height_excessflow = header[5];
+    return true;
+}
+
+/**
+ * Find a flow which satisfies lower bounds, capacities and supplies of vertices.
+ * Vertices with positive balance are fed from an implicit super source and
+ * vertices with negative balance drain to an implicit super sink,
+ * so no edges are added to the graph.
+ * 
+ * @return {bool}  : False if there is no feasible circulation
+ */
+bool Goldberg_flow::get_circulation() 
+{
+    init();
+    discharge();
+
+    for (const Vertex& vertex : m_vertices)
+        if (vertex.m_demand_flow < vertex.m_demand || vertex.m_supply_flow < vertex.m_supply)
+            return false;
+
+#ifdef FLOW_TRACE
+    std::printf("finish, feasible circulation\n");
 #endif
 
-    return max_flow;
+    return true;
+}
+
+/**
+ * Certificate of the infeasible circulation. 
+ * Returns a set of vertices X for which supplies of X and lower bounds 
+ * of edges coming to X exceed capacities of edges leaving X.
+ * If the total supply is lower than the total demand, such set may not exist.
+ * Then demands of X and lower bounds of edges leaving X exceed 
+ * capacities of edges coming to X.
+ * Has to be called after get_circulation().
+ * 
+ * @return {std::vector<int>}  : Indices of vertices of X, empty if the circulation exists
+ */
+std::vector<int> Goldberg_flow::get_violated_cut() 
+{
+    std::vector<bool> sink_side;
+    std::vector<int> cut;
+    int total_supply = 0;
+    bool feasible = true;
+
+    for (const Vertex& vertex : m_vertices){
+        total_supply += vertex.m_supply - vertex.m_demand;
+        if (vertex.m_demand_flow < vertex.m_demand || vertex.m_supply_flow < vertex.m_supply)
+            feasible = false;
+    }
+
+    if (feasible)
+        return cut;
+
+    // Vertices which can still send flow to the super sink
+    mark_sink_side(sink_side);
+
+    return source_side(sink_side, total_supply < 0);
+}
+
+/**
+ * Creates the edge if it doesn't exist yet
+ * 
+ * @param  {int} from     : Index of the vertex where the edge starts from
+ * @param  {int} to       : Index of the vertex where the edge comes to
+ * @param  {int} lower    : Minimal flow along the edge
+ * @param  {int} upper    : Capacity of the edge
+ * @return {Edge*}        : The edge from the vertex to another vertex
+ */
+Edge* Goldberg_flow::insert_edge(int from, int to, int lower, int upper) 
+{
+    auto edge = std::make_pair(from, to);
+    auto found = m_edges.find(edge);
+
+    if (found != m_edges.end())
+        return &found->second;
+
+    Edge* new_edge = &m_edges[edge];
+    *new_edge = Edge(&m_vertices[internal_index(from - 1)], &m_vertices[internal_index(to - 1)], upper - lower, lower);
+    
+    new_edge->m_start->m_edges.push_back(new_edge);
+    new_edge->m_end->m_edges.push_back(new_edge);
+    new_edge->m_index = m_edge_list.size();
+    m_edge_list.push_back(new_edge);
+
+    return new_edge;
 }
 
 /**
@@ -160,8 +918,12 @@ int Goldberg_flow::get_max_flow()
  */
 bool Goldberg_flow::edge_exists(int from, int to) const
 {
-    auto edge = std::make_pair(from, to);
-    return m_edges.find(edge) != m_edges.end();
+    if (m_edges.find(std::make_pair(from, to)) != m_edges.end())
+        return true;
+
+    // Undirected edge stored in the opposite direction
+    auto reverse = m_edges.find(std::make_pair(to, from));
+    return reverse != m_edges.end() && reverse->second.m_reverse_capacity > 0;
 }
 
 /**
@@ -172,7 +934,9 @@ void Goldberg_flow::print_graph()
 {
     for (auto& e : m_edges)
     {
-        printf("%d %d %d\n", get_index(e.second.m_start), get_index(e.second.m_end), e.second.m_capacity);
+        printf("%d %d %d\n", get_index(e.second.m_start), get_index(e.second.m_end), e.second.m_capacity + e.second.m_lower);
+        if (e.second.m_reverse_capacity > 0)
+            printf("%d %d %d\n", get_index(e.second.m_end), get_index(e.second.m_start), e.second.m_reverse_capacity);
     }
 }
 
@@ -182,23 +946,42 @@ void Goldberg_flow::print_graph()
  */
 void Goldberg_flow::print_flow_edges()
 {
+    for (const auto& edge : get_flow_edges())
+        printf("%d %d %d\n", edge.from, edge.to, edge.flow);
+}
+
+/**
+ * Collect all edges that have positive flow.
+ * Flows of the opposite edges are netted into one record, 
+ * negative flow of an undirected edge is reported in the opposite direction.
+ * 
+ * @return {std::vector<Flow_edge>}  : Edges with their flow
+ */
+std::vector<Flow_edge> Goldberg_flow::get_flow_edges() const
+{
+    std::vector<Flow_edge> result;
     std::unordered_map<edge_pair, bool, int_pair_hash> used;
 
     for (auto & edge : m_edges)
     {
-        if (used.find(edge.first) != used.end() || edge.second.m_flow == 0)
+        int flow = edge.second.m_flow + edge.second.m_lower;
+        if (used.find(edge.first) != used.end() || flow == 0)
             continue;
 
         auto rev_edge =  m_edges.find(std::make_pair(edge.first.second, edge.first.first));
         if (rev_edge != m_edges.end()){
-            printf("%d %d %d\n", edge.first.first, edge.first.second, edge.second.m_flow - rev_edge->second.m_flow);
+            flow -= rev_edge->second.m_flow + rev_edge->second.m_lower;
             used[rev_edge->first] = true;
         }
-        else{
-            printf("%d %d %d\n", edge.first.first, edge.first.second, edge.second.m_flow);
-        }
         used[edge.first] = true;
+
+        if (flow > 0)
+            result.push_back({edge.first.first, edge.first.second, flow});
+        else if (flow < 0)
+            result.push_back({edge.first.second, edge.first.first, -flow});
     }
+
+    return result;
 }
 
 /**
@@ -207,38 +990,144 @@ void Goldberg_flow::print_flow_edges()
  */
 void Goldberg_flow::init() 
 {
-    m_source->m_height = number_of_vertices();
+    m_initialized = true;
+
+    // Lower bounds are moved to the balances of the vertices
+    for (auto& vertex : m_vertices)
+        vertex.m_supply = vertex.m_balance;
+
+    for (auto& e : m_edges){
+        e.second.m_start->m_supply -= e.second.m_lower;
+        e.second.m_end->m_supply += e.second.m_lower;
+    }
+
+    // Terminals are connected to the implicit super source and super sink,
+    // unlimited terminals by the total capacity of their edges
+    for (auto& vertex : m_vertices){
+        if (vertex.m_source_limit == 0 && vertex.m_target_limit == 0)
+            continue;
+
+        long long outgoing = 0, incoming = 0;
+        for (auto edge : vertex.m_edges){
+            outgoing += edge->get_residual(&vertex);
+            incoming += edge->get_residual(edge->get_another_vertex(&vertex));
+        }
+
+        if (vertex.m_source_limit != 0)
+            vertex.m_supply += vertex.m_source_limit > 0? vertex.m_source_limit : 
+                               std::min<long long>(outgoing, std::numeric_limits<int>::max());
+        else
+            vertex.m_supply -= vertex.m_target_limit > 0? vertex.m_target_limit : 
+                               std::min<long long>(incoming, std::numeric_limits<int>::max());
+    }
+
+    for (auto& vertex : m_vertices){
+        vertex.m_demand = vertex.m_supply < 0? -vertex.m_supply : 0;
+        vertex.m_supply = vertex.m_supply > 0? vertex.m_supply : 0;
+    }
+
+    if (m_source)
+        m_source->m_height = top_height();
     test_height_limit();
 
-#ifndef NDEBUG
+#ifdef FLOW_TRACE
     std::printf("init\n");
 #endif
 
-    int flow = 0;
-    for (auto edge : m_source->m_edges){
+    for (auto& vertex : m_vertices){
+        if (vertex.m_supply == 0 || &vertex == m_source || &vertex == m_target)
+            continue;
 
-        if (edge->is_outgoing(m_source)){
-            flow = edge->m_capacity;
+        vertex.m_supply_flow = vertex.m_supply;
+        vertex.m_excess_flow += vertex.m_supply;
+        fix_excessflow(&vertex);
+    }
 
-            edge->m_flow += flow;
-            edge->m_end->m_excess_flow += flow; 
-            edge->m_start->m_excess_flow -= flow; 
-            fix_excessflow(edge->m_end);
-#ifndef NDEBUG
-            std::printf("push: from %d to %d flow %d ", get_index(m_source), get_index(edge->m_end), flow); 
+    if (!m_source)
+        return;
+
+    int flow = 0;
+    for (auto edge : m_source->m_edges){
+        Vertex* another_vertex = edge->get_another_vertex(m_source);
+        flow = edge->get_residual(m_source);
+
+        // Incoming directed edges have no residual from the source
+        if (flow > 0){
+            edge->m_flow += edge->is_outgoing(m_source)? flow : -flow;
+            another_vertex->m_excess_flow += flow; 
+            m_source->m_excess_flow -= flow; 
+            absorb_demand(another_vertex);
+            fix_excessflow(another_vertex);
+#ifdef FLOW_TRACE
+            std::printf("push: from %d to %d flow %d ", get_index(m_source), get_index(another_vertex), flow); 
             std::printf("| new flow %d\t", edge->m_flow);
             std::printf("| capacity %d\n", edge->m_capacity);
 #endif  
         }
     }
 
-#ifndef NDEBUG
+#ifdef FLOW_TRACE
     print_excessflow(0);
-
+#endif 
     test_excess_flow();
     test_flow();
     test_height_diff();
-#endif 
+}
+
+/**
+ * Heights are distances to the target in the residual graph, vertices which can 
+ * reach only the source are above the source by their distance to it.
+ * Vertices which reach none of them are on the top.
+ * 
+ */
+void Goldberg_flow::set_exact_heights() 
+{
+    std::vector<int> distance(m_vertices.size(), -1);
+
+    // The source is visited, so the search from the target does not pass through it
+    distance[position(m_source)] = top_height();
+    m_bfs.search(Residual_graph{*this}, {position(m_target)}, distance, 0);
+    m_bfs.search(Residual_graph{*this}, {position(m_source)}, distance, top_height());
+
+    for (size_t i = 0; i < m_vertices.size(); i++)
+        m_vertices[i].m_height = distance[i] >= 0? distance[i] : 2 * top_height() - 1;
+}
+
+/**
+ * Pushes and relabels vertices until there is no vertex with excess flow
+ * 
+ */
+void Goldberg_flow::discharge() 
+{
+    while (!discharge(std::numeric_limits<int>::max()));
+}
+
+/**
+ * Does at most the given number of pushes and relabels
+ * 
+ * @param  {int} operations : Maximal number of pushes and relabels
+ * @return {bool}           : True if there is no vertex with excess flow
+ */
+bool Goldberg_flow::discharge(int operations) 
+{
+    Vertex* vertex = get_max_excess_flow_vertex();
+    Edge* edge;  
+
+    while (vertex != nullptr && vertex->m_excess_flow > 0)
+    {
+        if (operations-- == 0)
+            return false;
+
+        edge = get_positive_residual_edge(vertex);       
+
+        if (edge != nullptr)
+            push(vertex, edge);
+        else if (!return_supply(vertex))
+            relable(vertex);
+
+        vertex = get_max_excess_flow_vertex();
+    }
+    return true;
 }
 
 /**
@@ -280,7 +1169,6 @@ void Goldberg_flow::push(Vertex* vertex, Edge* edge)
 {
     bool outgoing = edge->is_outgoing(vertex);
     int flow = std::min(vertex->m_excess_flow, edge->get_residual(vertex));
-    flow = !outgoing && flow > edge->m_flow? edge->m_flow : flow;
 
     int actual_flow = outgoing? flow : -flow;
     Vertex* target = edge->get_another_vertex(vertex);
@@ -290,19 +1178,19 @@ void Goldberg_flow::push(Vertex* vertex, Edge* edge)
     vertex->m_excess_flow -= flow;
     target->m_excess_flow += flow;
 
+    absorb_demand(target);
     fix_excessflow(target);
     fix_excessflow(vertex);
     fix_unsaturated(edge, vertex);
 
-#ifndef NDEBUG
+#ifdef FLOW_TRACE
     std::printf("push: from %d to %d actual flow %d, flow %d ", get_index(vertex), get_index(target), actual_flow, flow); 
     std::printf("| new flow %d, source ex_flow %d\t", edge->m_flow, vertex->m_excess_flow);
     std::printf("| capacity %d\n", edge->m_capacity);
     print_unsaturated(vertex);
-
-    test_excess_flow();
-    test_flow();
 #endif
+    test_push(vertex, target, edge);
+    test_periodic();
 }
 
 /**
@@ -316,17 +1204,390 @@ void Goldberg_flow::relable(Vertex* vertex)
     m_excessflow[vertex->m_height].erase(vertex->m_excessflow_iterator);
     vertex->m_height += 1;
     insert_excessflow_vertex(vertex);
-
-    if (vertex->m_height > m_height_excessflow)
-        m_height_excessflow = vertex->m_height;
     
     update_unsaturated_edges(vertex);
-#ifndef NDEBUG
+#ifdef FLOW_TRACE
     std::printf("relable: vertex %d, new height %d\n", get_index(vertex), vertex->m_height);
     print_unsaturated(vertex);
-    test_height_diff();
-    test_height_limit();
 #endif
+    test_relabel(vertex);
+    test_periodic();
+}
+
+/**
+ * Flow at the target and at the terminals of the multi-terminal flow
+ * 
+ * @return {int}  : Flow which reached the targets
+ */
+int Goldberg_flow::target_flow() const
+{
+    int flow = m_target? m_target->m_excess_flow : 0;
+
+    for (const Vertex& vertex : m_vertices)
+        if (vertex.m_target_limit != 0)
+            flow += vertex.m_demand_flow;
+
+    return flow;
+}
+
+/**
+ * Pushes the excess flow along the implicit edge to the super sink
+ * 
+ * @param  {Vertex*} vertex : Vertex with excess flow
+ */
+void Goldberg_flow::absorb_demand(Vertex* vertex) 
+{
+    int flow = std::min(vertex->m_excess_flow, vertex->m_demand - vertex->m_demand_flow);
+    if (flow <= 0 || vertex == m_target)
+        return;
+
+    vertex->m_demand_flow += flow;
+    vertex->m_excess_flow -= flow;
+}
+
+/**
+ * Returns the excess flow back to the super source, 
+ * if the vertex is higher than the super source
+ * 
+ * @param  {Vertex*} vertex : Vertex with excess flow
+ * @return {bool}           : False if no flow was returned
+ */
+bool Goldberg_flow::return_supply(Vertex* vertex) 
+{
+    if (vertex->m_supply_flow == 0 || vertex->m_height <= top_height())
+        return false;
+
+    int flow = std::min(vertex->m_excess_flow, vertex->m_supply_flow);
+    vertex->m_supply_flow -= flow;
+    vertex->m_excess_flow -= flow;
+    fix_excessflow(vertex);
+
+#ifdef FLOW_TRACE
+    std::printf("return: vertex %d flow %d\n", get_index(vertex), flow);
+#endif
+    test_vertex(vertex);
+    return true;
+}
+
+/**
+ * Marks vertices from which the target or a vertex 
+ * with unsatisfied demand is reachable in the residual graph
+ * 
+ * @param  {std::vector<bool>} sink_side : True for the reachable vertices
+ */
+void Goldberg_flow::mark_sink_side(std::vector<bool>& sink_side) 
+{
+    std::vector<int> sinks, distance(m_vertices.size(), -1);
+
+    for (auto& vertex : m_vertices)
+        if (&vertex == m_target || vertex.m_demand_flow < vertex.m_demand)
+            sinks.push_back(position(&vertex));
+
+    m_bfs.search(Residual_graph{*this}, sinks, distance);
+
+    sink_side.resize(m_vertices.size());
+    for (size_t i = 0; i < m_vertices.size(); i++)
+        sink_side[i] = distance[i] >= 0;
+}
+
+/**
+ * Sets the capacity of the parametric edge for the given lambda.
+ * Edges from the source to lower vertices stay saturated and the flow along edges 
+ * to the target is decreased to the new capacity, so the heights remain valid.
+ * 
+ * @param  {Parametric_edge} p_edge : Parametric edge
+ * @param  {int} lambda             : Parameter
+ */
+void Goldberg_flow::set_parametric_capacity(const Parametric_edge& p_edge, int lambda) 
+{
+    Edge* edge = p_edge.edge;
+    int capacity = p_edge.capacity + p_edge.slope * lambda;
+    int flow = 0;
+
+    assert(capacity >= 0);
+
+    // The source edges are saturated by init()
+    if (!m_initialized){
+        edge->m_capacity = capacity;
+        return;
+    }
+
+    // The edge is saturated only if it goes down, otherwise the residual edge is valid
+    if (edge->m_start == m_source){
+        if (edge->m_end->m_height < m_source->m_height)
+            flow = capacity - edge->m_capacity;
+    }
+    else
+        flow = std::min(capacity - edge->m_flow, 0);
+
+    edge->m_capacity = capacity;
+
+    if (flow != 0){
+        edge->m_flow += flow;
+        edge->m_start->m_excess_flow -= flow;
+        edge->m_end->m_excess_flow += flow;
+
+        absorb_demand(edge->m_end);
+        fix_excessflow(edge->m_end);
+        fix_excessflow(edge->m_start);
+    }
+
+    // Only the higher vertex can push along the edge
+    if (edge->m_start->m_height > edge->m_end->m_height)
+        fix_unsaturated(edge, edge->m_start);
+    else
+        fix_unsaturated(edge, edge->m_end);
+}
+
+/**
+ * Maximum flow and minimum cut for the lambda. The preflow of a lower lambda 
+ * is reused, the solving restarts from the zero flow for a higher one.
+ * 
+ * @param  {int} lambda                : Parameter
+ * @return {Parametric_sample}         : Cut with the line of its capacity
+ */
+Goldberg_flow::Parametric_sample Goldberg_flow::parametric_sample(int lambda) 
+{
+    if (m_initialized && lambda < m_lambda)
+        restart();
+
+    for (const auto& p_edge : m_parametric)
+        set_parametric_capacity(p_edge, lambda);
+
+    if (!m_initialized)
+        init();
+    discharge();
+    m_lambda = lambda;
+
+    Parametric_sample sample;
+    sample.lambda = lambda;
+    sample.max_flow = m_target->m_excess_flow;
+    mark_sink_side(sample.sink_side);
+    cut_line(sample.sink_side, sample.constant, sample.slope);
+    return sample;
+}
+
+/**
+ * Find the minimum cuts of the integer lambdas between the low and the high lambda.
+ * The minimum cut capacity is concave in the lambda, so if the cut where the lines 
+ * of the two cuts cross is one of them, no other cut lies between them on that side.
+ * Otherwise the new cut splits the interval.
+ * 
+ * @param  {int} low                            : Lambda with the cut samples.back()
+ * @param  {Parametric_sample} high             : Cut of the higher lambda, moved down to its first lambda
+ * @param  {std::vector<Parametric_sample>} samples : Found cuts, the cuts in between are appended
+ */
+void Goldberg_flow::search_breakpoints(int low, Parametric_sample& high, std::vector<Parametric_sample>& samples) 
+{
+    while (high.lambda - low > 1)
+    {
+        const Parametric_sample& left = samples.back();
+        double crossing = left.slope == high.slope? low : 
+                          double(left.constant - high.constant) / (high.slope - left.slope);
+        int lambda = std::min<double>(std::max<double>(std::floor(crossing), low + 1), high.lambda - 1);
+
+        Parametric_sample middle = parametric_sample(lambda);
+        if (middle.sink_side == left.sink_side)
+            low = lambda;
+        else if (middle.sink_side == high.sink_side)
+            high = std::move(middle);
+        else {
+            search_breakpoints(low, middle, samples);
+            samples.push_back(std::move(middle));
+            low = lambda;
+        }
+    }
+}
+
+/**
+ * Return to the zero flow before init(), the graph and the capacities are kept
+ * 
+ */
+void Goldberg_flow::restart() 
+{
+    for (Edge* edge : m_edge_list){
+        edge->m_flow = 0;
+        edge->m_unsaturated_placeID = -1;
+    }
+
+    for (auto& vertex : m_vertices){
+        vertex.m_height = 0;
+        vertex.m_excess_flow = 0;
+        vertex.m_supply_flow = vertex.m_demand_flow = 0;
+        vertex.m_excessflow_inserted = false;
+        vertex.m_unsaturated.clear();
+    }
+
+    for (auto& list : m_excessflow)
+        list.clear();
+    m_height_excessflow = 0;
+    m_active_vertices = 0;
+    m_initialized = false;
+}
+
+/**
+ * Capacity of the cut as a linear function of the lambda
+ * 
+ * @param  {std::vector<bool>} sink_side : Sink side of the cut
+ * @param  {long long} constant          : Capacity for the lambda 0
+ * @param  {long long} slope             : Increase of the capacity per unit of lambda
+ */
+void Goldberg_flow::cut_line(const std::vector<bool>& sink_side, long long& constant, long long& slope) 
+{
+    constant = slope = 0;
+
+    for (const auto& e : m_edges)
+        if (!sink_side[position(e.second.m_start)] && sink_side[position(e.second.m_end)])
+            constant += e.second.m_capacity;
+        else if (sink_side[position(e.second.m_start)] && !sink_side[position(e.second.m_end)])
+            constant += e.second.m_reverse_capacity;
+
+    for (const auto& p_edge : m_parametric){
+        if (!sink_side[position(p_edge.edge->m_start)] && sink_side[position(p_edge.edge->m_end)]){
+            constant += p_edge.capacity - p_edge.edge->m_capacity;
+            slope += p_edge.slope;
+        }
+    }
+}
+
+/**
+ * Original indices of vertices on one side of the cut
+ * 
+ * @param  {std::vector<bool>} sink_side : Sink side of the cut
+ * @param  {bool} side                   : Returns the sink side if true
+ * @return {std::vector<int>}            : Sorted indices of vertices
+ */
+std::vector<int> Goldberg_flow::source_side(const std::vector<bool>& sink_side, bool side) 
+{
+    std::vector<int> vertices;
+
+    for (int i = 0; i < m_vertices.size(); i++)
+        if (sink_side[i] == side)
+            vertices.push_back(get_index(&m_vertices[i]) + 1);
+
+    std::sort(vertices.begin(), vertices.end());
+    return vertices;
+}
+
+/**
+ * Renumbers vertices so that neighbours are stored close to each other.
+ * Indices on the input and the output stay the same.
+ * Has to be called after all edges are added and before the flow is computed.
+ * 
+ * @param  {Vertex_order} order : Breadth first search from the target, 
+ *                                reverse Cuthill-McKee or decreasing degree
+ */
+void Goldberg_flow::reorder_vertices(Vertex_order order) 
+{
+    assert(!m_initialized);
+
+    int n = m_vertices.size();
+    std::vector<int> new_order;
+    new_order.reserve(n);
+
+    if (order == BFS_FROM_TARGET){
+        bfs_order(new_order, m_target, false);
+    }
+    else if (order == REVERSE_CUTHILL_MCKEE){
+        bfs_order(new_order, nullptr, true);
+        std::reverse(new_order.begin(), new_order.end());
+    }
+    else {
+        for (int i = 0; i < n; i++)
+            new_order.push_back(i);
+
+        std::stable_sort(new_order.begin(), new_order.end(), [this](int a, int b){ 
+            return m_vertices[a].m_edges.size() > m_vertices[b].m_edges.size(); 
+        });
+    }
+
+    // Move vertices to their new positions
+    std::vector<int> new_position(n);
+    std::vector<Vertex> vertices(n);
+    for (int i = 0; i < n; i++){
+        new_position[new_order[i]] = i;
+        vertices[i] = std::move(m_vertices[new_order[i]]);
+    }
+
+    for (auto& e : m_edges){
+        e.second.m_start = &vertices[new_position[position(e.second.m_start)]];
+        e.second.m_end = &vertices[new_position[position(e.second.m_end)]];
+    }
+    if (m_source)
+        m_source = &vertices[new_position[position(m_source)]];
+    if (m_target)
+        m_target = &vertices[new_position[position(m_target)]];
+
+    m_vertices.swap(vertices);
+
+    // Edges of the vertex are sorted by the position of the another vertex
+    for (auto& vertex : m_vertices){
+        std::sort(vertex.m_edges.begin(), vertex.m_edges.end(), [&vertex](const Edge* a, const Edge* b){
+            return a->get_another_vertex(&vertex) < b->get_another_vertex(&vertex);
+        });
+    }
+
+    std::vector<int> original(n);
+    for (int i = 0; i < n; i++)
+        original[i] = m_original.empty()? new_order[i] : m_original[new_order[i]];
+
+    m_original.swap(original);
+    m_position.resize(n);
+    for (int i = 0; i < n; i++)
+        m_position[m_original[i]] = i;
+}
+
+/**
+ * Orders vertices by the breadth first search, ignoring directions of edges.
+ * Vertices which are not reachable start new searches.
+ * 
+ * @param  {std::vector<int>} order : Positions of vertices in the visiting order
+ * @param  {Vertex*} start          : First vertex, the vertex with minimal degree if null
+ * @param  {bool} by_degree         : Visit neighbours with lower degree first
+ */
+void Goldberg_flow::bfs_order(std::vector<int>& order, Vertex* start, bool by_degree) 
+{
+    int n = m_vertices.size();
+    std::vector<bool> visited(n, false);
+    std::vector<int> candidates(n);
+
+    for (int i = 0; i < n; i++)
+        candidates[i] = i;
+
+    auto lower_degree = [this](int a, int b){ 
+        return m_vertices[a].m_edges.size() < m_vertices[b].m_edges.size(); 
+    };
+
+    if (by_degree)
+        std::stable_sort(candidates.begin(), candidates.end(), lower_degree);
+    if (start)
+        candidates.insert(candidates.begin(), position(start));
+
+    for (int first : candidates)
+    {
+        if (visited[first])
+            continue;
+
+        visited[first] = true;
+        order.push_back(first);
+
+        for (size_t i = order.size() - 1; i < order.size(); i++)
+        {
+            Vertex* vertex = &m_vertices[order[i]];
+            size_t neighbours = order.size();
+
+            for (auto edge : vertex->m_edges){
+                int another = position(edge->get_another_vertex(vertex));
+                if (!visited[another]){
+                    visited[another] = true;
+                    order.push_back(another);
+                }
+            }
+
+            if (by_degree)
+                std::stable_sort(order.begin() + neighbours, order.end(), lower_degree);
+        }
+    }
 }
 
 /**
@@ -376,9 +1637,13 @@ void Goldberg_flow::fix_excessflow(Vertex* vertex)
     int h = vertex->m_height;
     // Excess flow is zero => remove from the vector and decrese max height
     if (vertex->m_excess_flow == 0){
+        if (vertex->m_excessflow_inserted == false)
+            return;
+
         m_excessflow[h].erase(vertex->m_excessflow_iterator);
         vertex->m_excessflow_iterator = m_excessflow[h].end();
         vertex->m_excessflow_inserted = false;
+        m_active_vertices--;
 
         while (m_excessflow[m_height_excessflow].size() == 0 && m_height_excessflow > 0)
             m_height_excessflow--;
@@ -387,6 +1652,7 @@ void Goldberg_flow::fix_excessflow(Vertex* vertex)
     else if (vertex->m_excessflow_inserted == false){
             insert_excessflow_vertex(vertex);
             vertex->m_excessflow_inserted = true;
+            m_active_vertices++;
     }
 }
 
@@ -399,6 +1665,9 @@ void Goldberg_flow::insert_excessflow_vertex(Vertex* vertex)
 {
     int h = vertex->m_height;
     vertex->m_excessflow_iterator = m_excessflow[h].insert(m_excessflow[h].begin(), vertex);
+
+    if (h > m_height_excessflow)
+        m_height_excessflow = h;
 }
 
 
@@ -416,21 +1685,21 @@ void Goldberg_flow::fix_unsaturated(Edge* edge, Vertex* vertex)
         residual = edge->get_residual(vertex);
 
     // Residual is zero => erase the edge from the list
-    if ((residual <= 0 || height_diff <= 0) && edge->m_unsaturated_placeID != 0){
-        if (get_index(vertex) == edge->m_unsaturated_placeID)
+    if ((residual <= 0 || height_diff <= 0) && edge->m_unsaturated_placeID != -1){
+        if (position(vertex) == edge->m_unsaturated_placeID)
             edge->m_unsaturated_iterator = vertex->m_unsaturated.erase(edge->m_unsaturated_iterator);
-        else if (get_index(another_vertex) == edge->m_unsaturated_placeID)
+        else if (position(another_vertex) == edge->m_unsaturated_placeID)
             edge->m_unsaturated_iterator = another_vertex->m_unsaturated.erase(edge->m_unsaturated_iterator);
 
-        edge->m_unsaturated_placeID = 0;
+        edge->m_unsaturated_placeID = -1;
     }
     else if (residual > 0 && height_diff > 0){
         // New edge => insert to the list
-        if(edge->m_unsaturated_placeID == 0){
+        if(edge->m_unsaturated_placeID == -1){
             insert_unsaturated_edge(edge, vertex);
         }
         // Another vertex has the edge => erase the edge and insert to vertex list
-        else if (get_index(another_vertex) == edge->m_unsaturated_placeID){
+        else if (position(another_vertex) == edge->m_unsaturated_placeID){
             another_vertex->m_unsaturated.erase(edge->m_unsaturated_iterator);
             insert_unsaturated_edge(edge, vertex);
         }
@@ -446,7 +1715,7 @@ void Goldberg_flow::fix_unsaturated(Edge* edge, Vertex* vertex)
 void Goldberg_flow::insert_unsaturated_edge(Edge* edge, Vertex* vertex) 
 {
     edge->m_unsaturated_iterator = vertex->m_unsaturated.insert(vertex->m_unsaturated.begin(), edge);
-    edge->m_unsaturated_placeID = get_index(vertex);
+    edge->m_unsaturated_placeID = position(vertex);
 }
 
 /**
@@ -6,7 +6,11 @@
 #include <cassert>
 #include <cstdlib>
 #include <cmath>
-#include <queue>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <sstream>
+#include <string>
 
 class Golberg_flow_tester
 {
@@ -17,67 +21,141 @@ public:
     Golberg_flow_tester(int seed) : m_random_seed(seed) {}
     ~Golberg_flow_tester(){}
 
+    std::vector<int> random_edges(int vertices, double probability, int max_capacity, int threads = 1) const;
     void random_graph(int vertices, int max_capacity);
     void test_random();
     void simple_graph_1();
     void simple_graph_2();
     void simple_graph_3();
     void random_graph_1();
+    void circulation_1();
+    void circulation_2();
+    void parametric_1();
+    void reorder_1();
+    void budget_1();
+    void undirected_1();
+    void generator_1();
+    void checkpoint_1();
+    void warm_start_1();
+    void multi_terminal_1();
 };
 
-bool Golberg_flow_tester::is_target_reachable(Goldberg_flow& g) const
-{
-    std::queue<int> q;
-    q.push(1);
-    bool used [g.number_of_vertices()];
-    int target = g.number_of_vertices();
+/**
+ * Directed edges of the graph as the graph of the BFS kernel, capacities are ignored
+ */
+struct Edge_graph {
+    Goldberg_flow& flow;
 
-    while (!q.empty())
+    int size()const{return flow.number_of_vertices() + 1;}
+    int degree(int v)const{return flow.vertex_neighbours(v).size();}
+
+    template <class Visit>
+    void for_each_successor(int v, Visit visit) const
     {
-        int cur = q.front();
-        q.pop();
+        for (const auto edge : flow.vertex_neighbours(v))
+            if (flow.get_index(edge->get_start()) == v)
+                visit(flow.get_index(edge->get_end()));
+    }
 
-        for (const auto edge : g.vertex_neighbours(cur)){
-            if (g.get_index(edge->get_start()) != cur)
-                continue;
+    template <class Test>
+    bool any_predecessor(int v, Test test) const
+    {
+        for (const auto edge : flow.vertex_neighbours(v))
+            if (flow.get_index(edge->get_end()) == v && test(flow.get_index(edge->get_start())))
+                return true;
+        return false;
+    }
+};
 
-            int neighbor = g.get_index(edge->get_end());
+bool Golberg_flow_tester::is_target_reachable(Goldberg_flow& g) const
+{
+    // Tests put the source first and the target last
+    Edge_graph graph{g};
+    std::vector<int> distance(graph.size(), -1);
 
-            if (neighbor == target)
-                return true;
+    Bitmap_bfs().search(graph, {0}, distance);
+    return distance[g.number_of_vertices()] >= 0;
+}
 
-            if (!used[neighbor]){
-                q.push(neighbor);
-                used[neighbor] = true;
+/**
+ * Random directed graph where every edge exists with the given probability.
+ * Pairs of vertices are numbered and the gaps between the chosen pairs are drawn 
+ * from the geometric distribution, so the time is linear in the number of edges.
+ * Rows of pairs are split into blocks generated by threads, every block has its own 
+ * random stream, so the result does not depend on the number of threads.
+ * 
+ * @param  {int} vertices        : Number of vertices
+ * @param  {double} probability  : Probability of every edge
+ * @param  {int} max_capacity    : Capacities are from 1 to max_capacity
+ * @param  {int} threads         : Number of threads
+ * @return {std::vector<int>}    : Triples from, to, capacity sorted by the vertices
+ */
+std::vector<int> Golberg_flow_tester::random_edges(int vertices, double probability, int max_capacity, int threads) const
+{
+    const int rows_per_block = 1024;
+    int blocks = (vertices + rows_per_block - 1) / rows_per_block;
+    std::vector<std::vector<int>> block_edges(blocks);
+    std::atomic<int> next_block(0);
+
+    if (probability <= 0)
+        return std::vector<int>();
+
+    auto generate = [&](){
+        for (int b = next_block++; b < blocks; b = next_block++){
+            RandomGen random(m_random_seed + 7919 * b);
+            std::vector<int>& edges = block_edges[b];
+
+            // Pairs of the block are numbered row by row, vertex i has vertices - 1 pairs
+            uint64_t first_row = uint64_t(b) * rows_per_block,
+                     rows = std::min<uint64_t>(rows_per_block, vertices - first_row),
+                     pairs = rows * (vertices - 1);
+            double log_q = std::log(1 - probability);
+
+            for (uint64_t pair = 0; ; pair++){
+                if (probability < 1){
+                    // Uniform number from (0, 1]
+                    double u = ((random.next_u64() >> 11) + 1) * (1.0 / 9007199254740992.0);
+                    double skip = std::floor(std::log(u) / log_q);
+                    if (skip >= pairs - pair)
+                        break;
+                    pair += uint64_t(skip);
+                }
+                if (pair >= pairs)
+                    break;
+
+                int from = first_row + pair / (vertices - 1),
+                    to = pair % (vertices - 1);
+                to += to >= from? 1 : 0;
+
+                edges.push_back(from + 1);
+                edges.push_back(to + 1);
+                edges.push_back(random.next_range(max_capacity) + 1);
             }
         }
-    }
-    return false;
+    };
+
+    std::vector<std::thread> workers;
+    for (int t = 1; t < threads; t++)
+        workers.emplace_back(generate);
+    generate();
+    for (auto& worker : workers)
+        worker.join();
+
+    std::vector<int> edges;
+    for (const auto& block : block_edges)
+        edges.insert(edges.end(), block.begin(), block.end());
+    return edges;
 }
 
 void Golberg_flow_tester::random_graph(int vertices, int max_capacity) 
 {
-    RandomGen random(m_random_seed);
     float probability = (1 + log(vertices)) / vertices;
     int start = 1, 
         end = vertices;
 
     Goldberg_flow g(vertices, start, end);
+    g.add_edges(random_edges(vertices, probability, max_capacity, std::thread::hardware_concurrency()));
 
-    for (int i = 0; i < vertices; i++)
-    {
-        for (int j = 0; j < vertices; j++)
-        {
-            if (i == j || g.edge_exists(i, j))
-                continue;
-
-            float p = (float)random.next_range(100) / 100;
-            if (probability < p){
-                unsigned int capacity = random.next_range(max_capacity)  + 1;
-                g.add_edge(i, j, capacity);
-            }
-        }
-    }
 #ifndef NDEBUG
     g.print_graph();
 #endif
@@ -188,6 +266,432 @@ void Golberg_flow_tester::random_graph_1()
     assert(g.get_max_flow() == 129);
 }
 
+void Golberg_flow_tester::circulation_1() 
+{
+    Goldberg_flow g (4);
+    g.set_supply(1, 5);
+    g.set_supply(4, -5);
+    g.add_edge(1, 2, 2, 4);
+    g.add_edge(1, 3, 0, 4);
+    g.add_edge(2, 3, 1, 3);
+    g.add_edge(2, 4, 0, 2);
+    g.add_edge(3, 4, 3, 5);
+    g.add_edge(4, 1, 0, 1);
+
+    assert(g.get_circulation());
+    assert(g.get_violated_cut().empty());
+
+    int balance[5] = {0, 5, 0, 0, -5};
+    for (const auto& edge : g.get_flow_edges()){
+        balance[edge.from] -= edge.flow;
+        balance[edge.to] += edge.flow;
+    }
+    for (int i = 1; i <= 4; i++)
+        assert(balance[i] == 0);
+}
+
+void Golberg_flow_tester::circulation_2() 
+{
+    Goldberg_flow g (4);
+    g.add_edge(1, 2, 3, 5);
+    g.add_edge(2, 3, 0, 2);
+    g.add_edge(3, 1, 0, 2);
+    g.add_edge(2, 4, 0, 9);
+    g.add_edge(4, 3, 0, 9);
+    g.set_supply(4, -2);
+    g.set_supply(3, 2);
+
+    assert(!g.get_circulation());
+
+    // Supplies and lower bounds of incoming edges exceed capacities of outgoing edges
+    std::vector<int> cut = g.get_violated_cut();
+    std::vector<bool> in_cut(5, false);
+    for (int v : cut)
+        in_cut[v] = true;
+
+    int supply[5] = {0, 0, 0, 2, -2};
+    int lower[5][5] = {}, upper[5][5] = {};
+    lower[1][2] = 3; upper[1][2] = 5;
+    upper[2][3] = 2; upper[3][1] = 2; upper[2][4] = 9; upper[4][3] = 9;
+
+    int excess = 0;
+    for (int i = 1; i <= 4; i++){
+        if (!in_cut[i])
+            continue;
+        excess += supply[i];
+        for (int j = 1; j <= 4; j++)
+            excess += in_cut[j]? 0 : lower[j][i] - upper[i][j];
+    }
+    assert(!cut.empty() && excess > 0);
+}
+
+void Golberg_flow_tester::parametric_1() 
+{
+    // from, to, capacity, slope
+    int edges[][4] = {{1, 2, 0, 2}, {1, 3, 1, 3}, {2, 3, 3, 0}, {2, 4, 4, 0}, {3, 4, 6, 0}, 
+                      {3, 5, 2, 0}, {4, 5, 10, 0}, {3, 6, 20, -2}, {4, 6, 9, -1}, {5, 6, 12, -1}};
+    Goldberg_flow g (6, 1, 6);
+    std::vector<int> lambdas;
+
+    for (auto& e : edges){
+        if (e[3] == 0)
+            g.add_edge(e[0], e[1], e[2]);
+        else
+            g.add_parametric_edge(e[0], e[1], e[2], e[3]);
+    }
+    for (int lambda = 0; lambda <= 9; lambda++)
+        lambdas.push_back(lambda);
+
+    std::vector<Parametric_cut> cuts = g.get_parametric_cuts(lambdas);
+    assert(cuts.size() > 1 && cuts[0].lambda == 0);
+
+    for (int lambda = 0, c = 0; lambda <= 9; lambda++){
+        if (c + 1 < cuts.size() && cuts[c + 1].lambda == lambda)
+            c++;
+
+        // Cuts are nested
+        if (c > 0)
+            for (int v : cuts[c - 1].source_side)
+                assert(std::find(cuts[c].source_side.begin(), cuts[c].source_side.end(), v) != cuts[c].source_side.end());
+
+        Goldberg_flow h (6, 1, 6);
+        int capacity = 0;
+        for (auto& e : edges){
+            int cap = e[2] + e[3] * lambda;
+            if (cap > 0)
+                h.add_edge(e[0], e[1], cap);
+
+            bool from_source_side = std::find(cuts[c].source_side.begin(), cuts[c].source_side.end(), e[0]) != cuts[c].source_side.end();
+            bool to_source_side = std::find(cuts[c].source_side.begin(), cuts[c].source_side.end(), e[1]) != cuts[c].source_side.end();
+            if (from_source_side && !to_source_side)
+                capacity += cap;
+        }
+
+        int max_flow = h.get_max_flow();
+        assert(max_flow == capacity);
+        if (cuts[c].lambda == lambda)
+            assert(max_flow == cuts[c].max_flow);
+        if (c > 0)
+            assert(cuts[c].breakpoint > cuts[c - 1].lambda && cuts[c].breakpoint <= cuts[c].lambda);
+    }
+
+    // Breakpoints between the given lambdas are searched, the cuts are the same as for all lambdas
+    auto same_cuts = [](const std::vector<Parametric_cut>& a, const std::vector<Parametric_cut>& b){
+        assert(a.size() == b.size());
+        for (size_t i = 0; i < a.size(); i++)
+            assert(a[i].lambda == b[i].lambda && a[i].breakpoint == b[i].breakpoint && 
+                   a[i].max_flow == b[i].max_flow && a[i].source_side == b[i].source_side);
+    };
+    assert(cuts.size() >= 3);
+    same_cuts(g.get_parametric_cuts({0, 9}), cuts);
+    same_cuts(g.get_parametric_cuts({0, 2, 9}), cuts);
+
+    // Random inner graph with parametric edges from the source and to the target
+    int inner = 60, max_lambda = 40;
+    std::vector<int> inner_edges = random_edges(inner, 0.1, 20);
+    Goldberg_flow sweep (inner + 2, 1, inner + 2), search (inner + 2, 1, inner + 2);
+    RandomGen random(m_random_seed);
+
+    for (Goldberg_flow* flow : {&sweep, &search})
+        for (size_t i = 0; i < inner_edges.size(); i += 3)
+            flow->add_edge(inner_edges[i] + 1, inner_edges[i + 1] + 1, inner_edges[i + 2]);
+    for (int v = 2; v <= inner + 1; v++){
+        int capacity = random.next_range(10), slope = random.next_range(4),
+            sink_slope = random.next_range(4), sink_capacity = sink_slope * max_lambda + random.next_range(10);
+        for (Goldberg_flow* flow : {&sweep, &search}){
+            flow->add_parametric_edge(1, v, capacity, slope);
+            flow->add_parametric_edge(v, inner + 2, sink_capacity, -sink_slope);
+        }
+    }
+
+    std::vector<int> all_lambdas;
+    for (int lambda = 0; lambda <= max_lambda; lambda++)
+        all_lambdas.push_back(lambda);
+
+    std::vector<Parametric_cut> swept = sweep.get_parametric_cuts(all_lambdas);
+    assert(swept.size() > 2);
+    same_cuts(search.get_parametric_cuts({0, max_lambda}), swept);
+    assert(search.get_max_flow() == sweep.get_max_flow());
+}
+
+void Golberg_flow_tester::reorder_1() 
+{
+    int edges[][3] = {{8, 4, 41}, {4, 8, 14}, {5, 9, 44}, {6, 10, 22}, {8, 9, 26}, {3, 2, 50}, 
+                      {6, 7, 9}, {9, 3, 1}, {3, 9, 42}, {2, 8, 3}, {8, 2, 34}, {4, 2, 36}, 
+                      {1, 7, 41}, {4, 1, 26}, {2, 7, 23}, {1, 4, 49}, {8, 10, 7}, {4, 6, 32}, 
+                      {1, 3, 47}, {5, 7, 45}, {6, 4, 29}, {7, 5, 47}, {1, 8, 22}, {2, 10, 29}, 
+                      {1, 9, 23}, {1, 10, 29}, {8, 3, 41}, {9, 10, 42}};
+
+    for (Vertex_order order : {BFS_FROM_TARGET, REVERSE_CUTHILL_MCKEE, DEGREE_SORTED}){
+        Goldberg_flow g (10, 1, 10);
+        for (auto& e : edges)
+            g.add_edge(e[0], e[1], e[2]);
+
+        g.reorder_vertices(order);
+        assert(is_target_reachable(g));
+        assert(g.get_max_flow() == 129);
+
+        // Flow is conserved in the original indices
+        int balance[11] = {};
+        for (const auto& edge : g.get_flow_edges()){
+            assert(g.edge_exists(edge.from, edge.to));
+            balance[edge.from] -= edge.flow;
+            balance[edge.to] += edge.flow;
+        }
+        assert(balance[1] == -129 && balance[10] == 129);
+        for (int i = 2; i < 10; i++)
+            assert(balance[i] == 0);
+    }
+}
+
+void Golberg_flow_tester::budget_1() 
+{
+    int edges[][3] = {{8, 4, 41}, {4, 8, 14}, {5, 9, 44}, {6, 10, 22}, {8, 9, 26}, {3, 2, 50}, 
+                      {6, 7, 9}, {9, 3, 1}, {3, 9, 42}, {2, 8, 3}, {8, 2, 34}, {4, 2, 36}, 
+                      {1, 7, 41}, {4, 1, 26}, {2, 7, 23}, {1, 4, 49}, {8, 10, 7}, {4, 6, 32}, 
+                      {1, 3, 47}, {5, 7, 45}, {6, 4, 29}, {7, 5, 47}, {1, 8, 22}, {2, 10, 29}, 
+                      {1, 9, 23}, {1, 10, 29}, {8, 3, 41}, {9, 10, 42}};
+
+    Goldberg_flow g (10, 1, 10);
+    for (auto& e : edges)
+        g.add_edge(e[0], e[1], e[2]);
+
+    std::atomic<bool> cancel(false);
+    int calls = 0, last_flow = 0;
+    auto progress = [&](const Flow_progress& p){
+        // Flow at the target only grows and never exceeds the maximum flow
+        assert(p.target_flow >= last_flow && p.target_flow <= 129);
+        last_flow = p.target_flow;
+        if (++calls == 1)
+            cancel = true;
+    };
+
+    assert(g.solve(Clock::time_point::max(), &cancel, progress, 1) == CANCELLED);
+    assert(calls == 1 && g.get_progress().active_vertices > 0);
+
+    // Deadline in the past stops the solving after the first check
+    assert(g.solve(Clock::now(), nullptr, progress, 1) == TIMED_OUT);
+    assert(calls == 2);
+
+    // The stopped state is resumed
+    assert(g.solve(Clock::time_point::max(), nullptr, progress) == SOLVED);
+    assert(g.get_progress().target_flow == 129 && g.get_progress().active_vertices == 0);
+
+    // Intervals below 1 still make one operation between the checks
+    for (int interval : {0, -5}){
+        Goldberg_flow h (10, 1, 10);
+        for (auto& e : edges)
+            h.add_edge(e[0], e[1], e[2]);
+
+        Solve_status status = TIMED_OUT;
+        for (int steps = 0; steps < 100000 && status != SOLVED; steps++)
+            status = h.solve(Clock::now(), nullptr, nullptr, interval);
+        assert(status == SOLVED && h.get_progress().target_flow == 129);
+    }
+}
+
+void Golberg_flow_tester::undirected_1() 
+{
+    // Same graph with undirected edges and with pairs of directed edges
+    int edges[][3] = {{1, 2, 10}, {1, 3, 13}, {2, 3, 3}, {3, 6, 7}, {3, 4, 6}, {4, 5, 10}, {5, 6, 5}, {4, 2, 8}};
+    Goldberg_flow g (6, 1, 6), h (6, 1, 6);
+
+    for (auto& e : edges){
+        g.add_undirected_edge(e[0], e[1], e[2]);
+        h.add_edge(e[0], e[1], e[2]);
+        h.add_edge(e[1], e[0], e[2]);
+    }
+    assert(g.number_of_edges() == 8);
+    assert(g.edge_exists(2, 1) && g.edge_exists(1, 2));
+
+    int max_flow = g.get_max_flow();
+    assert(max_flow == h.get_max_flow());
+
+    int balance[7] = {};
+    for (const auto& edge : g.get_flow_edges()){
+        assert(edge.flow > 0);
+        balance[edge.from] -= edge.flow;
+        balance[edge.to] += edge.flow;
+    }
+    assert(balance[1] == -max_flow && balance[6] == max_flow);
+    for (int i = 2; i < 6; i++)
+        assert(balance[i] == 0);
+}
+
+void Golberg_flow_tester::generator_1() 
+{
+    int vertices = 3000;
+    double probability = 0.002;
+    std::vector<int> edges = random_edges(vertices, probability, 10, 1);
+
+    // The same edges for any number of threads
+    assert(edges == random_edges(vertices, probability, 10, 4));
+
+    // Edges are sorted, without loops and duplicates
+    for (size_t i = 0; i < edges.size(); i += 3){
+        assert(edges[i] != edges[i + 1]);
+        assert(1 <= edges[i + 2] && edges[i + 2] <= 10);
+        if (i > 0)
+            assert(std::make_pair(edges[i - 3], edges[i - 2]) < std::make_pair(edges[i], edges[i + 1]));
+    }
+
+    double expected = probability * vertices * (vertices - 1);
+    assert(std::fabs(edges.size() / 3 - expected) < 5 * std::sqrt(expected));
+}
+
+void Golberg_flow_tester::checkpoint_1() 
+{
+    int vertices = 1000;
+    std::vector<int> edges = random_edges(vertices, 0.01, 50);
+    auto by_vertices = [](const Flow_edge& a, const Flow_edge& b){ 
+        return std::make_pair(a.from, a.to) < std::make_pair(b.from, b.to); 
+    };
+
+    Goldberg_flow fresh (vertices, 1, vertices);
+    fresh.add_edges(edges);
+    int max_flow = fresh.get_max_flow();
+
+    // Interrupt the solving and save the state
+    Goldberg_flow g (vertices, 1, vertices);
+    g.add_edges(edges);
+    std::atomic<bool> cancel(true);
+    assert(g.solve(Clock::time_point::max(), &cancel, nullptr, 100) == CANCELLED);
+
+    std::stringstream checkpoint;
+    g.save_checkpoint(checkpoint);
+
+    // Resume the same solving in another object
+    Goldberg_flow h (vertices, 1, vertices);
+    h.add_edges(edges);
+    assert(h.load_checkpoint(checkpoint));
+    assert(h.get_progress().active_vertices == g.get_progress().active_vertices);
+
+    assert(g.get_max_flow() == max_flow);
+    assert(h.get_max_flow() == max_flow);
+
+    std::vector<Flow_edge> g_edges = g.get_flow_edges(), h_edges = h.get_flow_edges();
+    std::sort(g_edges.begin(), g_edges.end(), by_vertices);
+    std::sort(h_edges.begin(), h_edges.end(), by_vertices);
+    assert(g_edges.size() == h_edges.size());
+    for (size_t i = 0; i < g_edges.size(); i++)
+        assert(g_edges[i].from == h_edges[i].from && g_edges[i].to == h_edges[i].to && g_edges[i].flow == h_edges[i].flow);
+
+    // Checkpoint of another graph is refused
+    Goldberg_flow other (vertices, 1, vertices);
+    other.add_edge(1, 2, 5);
+    checkpoint.seekg(0);
+    assert(!other.load_checkpoint(checkpoint));
+
+    // Truncated checkpoint, flow over the capacity and excess not matching the flows 
+    // are refused and the graph is left untouched
+    std::string bytes = checkpoint.str();
+    std::vector<std::string> broken(3, bytes);
+    broken[0].resize(bytes.size() - sizeof(int32_t));
+    int32_t* words = reinterpret_cast<int32_t*>(&broken[1][0]);
+    words[7] = words[6] + 1;
+    words = reinterpret_cast<int32_t*>(&broken[2][0]);
+    words[6 + 2 * g.number_of_edges() + 6 * (vertices / 2) + 1]++;
+
+    for (const std::string& checkpoint_bytes : broken){
+        Goldberg_flow k (vertices, 1, vertices);
+        k.add_edges(edges);
+        std::stringstream stream(checkpoint_bytes);
+        assert(!k.load_checkpoint(stream));
+        assert(k.get_progress().active_vertices == 0 && k.get_progress().target_flow == 0);
+        assert(k.get_max_flow() == max_flow);
+    }
+}
+
+void Golberg_flow_tester::warm_start_1() 
+{
+    int vertices = 1000;
+    std::vector<int> edges = random_edges(vertices, 0.01, 50);
+
+    Goldberg_flow fresh (vertices, 1, vertices);
+    fresh.add_edges(edges);
+    int max_flow = fresh.get_max_flow();
+    std::vector<Flow_edge> flows = fresh.get_flow_edges();
+
+    // Maximum flow leaves nothing to do
+    Goldberg_flow g (vertices, 1, vertices);
+    g.add_edges(edges);
+    assert(g.warm_start(flows));
+    assert(g.get_progress().active_vertices == 0 && g.get_progress().target_flow == max_flow);
+    assert(g.get_max_flow() == max_flow);
+
+    // Flow of the previous day with lower capacities
+    std::vector<int> yesterday = edges;
+    for (size_t i = 2; i < yesterday.size(); i += 3)
+        yesterday[i] = std::max(1, yesterday[i] - 10);
+
+    Goldberg_flow y (vertices, 1, vertices);
+    y.add_edges(yesterday);
+    y.get_max_flow();
+
+    Goldberg_flow h (vertices, 1, vertices);
+    h.add_edges(edges);
+    assert(h.warm_start(y.get_flow_edges()));
+    assert(h.get_max_flow() == max_flow);
+
+    // Flows over the capacity or not conserved are refused
+    Goldberg_flow s (6, 1, 6);
+    s.add_edge(1, 2, 10);
+    s.add_edge(2, 3, 5);
+    s.add_edge(3, 6, 7);
+    assert(!s.warm_start({{1, 2, 11}, {2, 3, 11}, {3, 6, 11}}));
+    assert(!s.warm_start({{1, 2, 5}, {2, 3, 4}, {3, 6, 4}}));
+    assert(s.warm_start({{1, 2, 3}, {2, 3, 3}, {3, 6, 3}}));
+    assert(s.get_max_flow() == 5);
+}
+
+void Golberg_flow_tester::multi_terminal_1() 
+{
+    int vertices = 500;
+    std::vector<int> edges = random_edges(vertices, 0.02, 20);
+    int sources[][2] = {{1, -1}, {2, 15}, {3, 40}, {4, -1}},
+        targets[][2] = {{vertices, -1}, {vertices - 1, 25}, {vertices - 2, -1}};
+
+    // The same flow with the materialized super source and super sink
+    Goldberg_flow g (vertices);
+    Goldberg_flow h (vertices + 2, vertices + 1, vertices + 2);
+    g.add_edges(edges);
+    h.add_edges(edges);
+
+    for (auto& s : sources){
+        g.add_source(s[0], s[1]);
+        h.add_edge(vertices + 1, s[0], s[1] > 0? s[1] : 1000000);
+    }
+    for (auto& t : targets){
+        g.add_target(t[0], t[1]);
+        h.add_edge(t[0], vertices + 2, t[1] > 0? t[1] : 1000000);
+    }
+    assert(g.number_of_edges() + 7 == h.number_of_edges());
+
+    int max_flow = g.get_max_flow();
+    assert(max_flow == h.get_max_flow());
+    assert(g.get_progress().target_flow == max_flow);
+
+    // Flow is conserved except at the terminals, which respect their limits
+    std::vector<int> balance(vertices + 1, 0);
+    for (const auto& edge : g.get_flow_edges()){
+        balance[edge.from] -= edge.flow;
+        balance[edge.to] += edge.flow;
+    }
+    int sent = 0, received = 0;
+    for (auto& s : sources){
+        assert(balance[s[0]] <= 0 && (s[1] < 0 || -balance[s[0]] <= s[1]));
+        sent -= balance[s[0]];
+        balance[s[0]] = 0;
+    }
+    for (auto& t : targets){
+        assert(balance[t[0]] >= 0 && (t[1] < 0 || balance[t[0]] <= t[1]));
+        received += balance[t[0]];
+        balance[t[0]] = 0;
+    }
+    assert(sent == max_flow && received == max_flow);
+    assert(std::count(balance.begin(), balance.end(), 0) == vertices + 1);
+}
+
 #ifndef NDEBUG
 
 void Goldberg_flow::test_height_diff() 
@@ -198,31 +702,75 @@ void Goldberg_flow::test_height_diff()
         if (residual > 0){
             assert((e.second.get_start()->get_height() - e.second.get_end()->get_height()) <= 1);
         }
+        residual = e.second.get_residual(e.second.m_end);
+        if (residual > 0){
+            assert((e.second.get_end()->get_height() - e.second.get_start()->get_height()) <= 1);
+        }
     }
 }
 
 void Goldberg_flow::test_excess_flow() 
 {
-    for(const Vertex& vertex : m_vertices){      
-        int e_flow = 0;
-        for (const auto& edge : vertex.m_edges)
-        {
-            if (edge->is_outgoing(&vertex))
-                e_flow -= edge->get_flow(edge->m_start);
-            else
-                e_flow += edge->get_flow(edge->m_start);
-        }
+    for(const Vertex& vertex : m_vertices)
+        test_vertex(&vertex);
+}
 
-        if (&vertex != m_source){
-            assert(vertex.get_excess_flow() >= 0);    
-            assert(vertex.get_excess_flow() == e_flow);    
-        }
+void Goldberg_flow::test_vertex(const Vertex* vertex) 
+{
+    int e_flow = 0;
+    for (const auto& edge : vertex->m_edges)
+    {
+        if (edge->is_outgoing(vertex))
+            e_flow -= edge->get_flow(edge->m_start);
+        else
+            e_flow += edge->get_flow(edge->m_start);
     }
+    e_flow += vertex->m_supply_flow - vertex->m_demand_flow;
+
+    if (vertex != m_source){
+        assert(vertex->get_excess_flow() >= 0);    
+        assert(vertex->get_excess_flow() == e_flow);    
+    }
+}
+
+// Only the pushed edge and its vertices are changed by the push
+void Goldberg_flow::test_push(const Vertex* vertex, const Vertex* target, const Edge* edge) 
+{
+    int flow = edge->get_flow(edge->m_start);
+    assert(-edge->get_reverse_capacity() <= flow && flow <= edge->get_capacity());
+    assert(vertex->get_height() - target->get_height() == 1);
+    assert(vertex == m_source || vertex->get_excess_flow() >= 0);
+    assert(target == m_source || target->get_excess_flow() >= 0);
+}
+
+// Only the edges of the relabeled vertex can become invalid
+void Goldberg_flow::test_relabel(const Vertex* vertex) 
+{
+    for (const auto& edge : vertex->m_edges){
+        const Vertex* another_vertex = edge->get_another_vertex(vertex);
+        if (edge->get_residual(vertex) > 0)
+            assert(vertex->get_height() - another_vertex->get_height() <= 1);
+    }
+    assert(vertex->get_height() <= 2 * top_height());
+    test_vertex(vertex);
+}
+
+void Goldberg_flow::test_periodic() 
+{
+    int interval = m_check_interval < 0? m_vertices.size() + m_edges.size() : m_check_interval;
+    if (interval == 0 || ++m_check_counter < interval)
+        return;
+
+    m_check_counter = 0;
+    test_excess_flow();
+    test_flow();
+    test_height_diff();
+    test_height_limit();
 }
 
 void Goldberg_flow::test_height_limit() 
 {
-    int limit = m_vertices.size() - 1;
+    int limit = top_height();
 
     for(const Vertex& vertex : m_vertices){
         if (&vertex == m_source){
@@ -240,13 +788,14 @@ void Goldberg_flow::test_flow()
     int flow = 0;
     for(const auto& e : m_edges){
         flow = e.second.get_flow(e.second.m_start);
-        assert(0 <= flow && flow <= e.second.get_capacity());
+        assert(-e.second.get_reverse_capacity() <= flow && flow <= e.second.get_capacity());
     }
 }
 
-void Goldberg_flow::test_edge(int from, int to, int capacity) 
+void Goldberg_flow::test_edge(int from, int to, int lower, int upper) 
 {
-    assert(capacity > 0);
+    assert(upper > 0);
+    assert(0 <= lower && lower <= upper);
     assert(from != to);
     assert(from >= 0 && from < m_vertices.size());
     assert(to >= 0 && to < m_vertices.size());
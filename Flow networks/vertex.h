@@ -14,6 +14,15 @@ class Vertex
 private:
     int m_height;
     int m_excess_flow;
+    // Supply given by the user (negative for demand)
+    int m_balance;
+    // Capacities and flows of the implicit edges 
+    // from the super source and to the super sink
+    int m_supply, m_supply_flow;
+    int m_demand, m_demand_flow;
+    // Limits of the multi-terminal flow from the super source and to the super sink,
+    // 0 if the vertex is not a terminal and -1 if the terminal is not limited
+    int m_source_limit, m_target_limit;
     std::vector<Edge*> m_edges;
     // False if the vertex is not inserted to any list
     bool m_excessflow_inserted;
@@ -21,12 +30,30 @@ private:
     std::list<Edge*> m_unsaturated;
 public:
     Vertex() : 
-       m_height(0), m_excess_flow(0), m_excessflow_inserted(false) {}
+       m_height(0), m_excess_flow(0), m_balance(0), m_supply(0), m_supply_flow(0), 
+       m_demand(0), m_demand_flow(0), m_source_limit(0), m_target_limit(0), 
+       m_excessflow_inserted(false) {}
     Vertex(int height) : 
-        m_height(height), m_excess_flow(0), m_excessflow_inserted(false) {}
+        m_height(height), m_excess_flow(0), m_balance(0), m_supply(0), m_supply_flow(0), 
+        m_demand(0), m_demand_flow(0), m_source_limit(0), m_target_limit(0), 
+       m_excessflow_inserted(false) {}
 
     int get_height() const {return m_height;}
     int get_excess_flow() const {return m_excess_flow;}
+
+    // Reset the state but keep the allocated adjacency storage
+    void clear()
+    {
+        m_height = 0;
+        m_excess_flow = 0;
+        m_balance = 0;
+        m_supply = m_supply_flow = 0;
+        m_demand = m_demand_flow = 0;
+        m_source_limit = m_target_limit = 0;
+        m_edges.clear();
+        m_excessflow_inserted = false;
+        m_unsaturated.clear();
+    }
 };
 
 #endif // __VERTEX__
\ No newline at end of file
@@ -0,0 +1,492 @@
+#ifndef __COMPACT_RB_TREE_H__
+#define __COMPACT_RB_TREE_H__
+
+#include "node.h"
+#include <cstdint>
+#include <vector>
+#include <limits>
+#include <stdexcept>
+#include <functional>
+#include <utility>
+
+/**
+ * Red black tree of unique keys with the nodes stored in one array.
+ * Nodes are linked by 32-bit indices. The fields read by the descents 
+ * take 16 bytes for int keys, so they never cross a cache line, and the parents 
+ * used only by the updates are in a parallel array with the color as the highest bit.
+ * A key takes 20 bytes instead of 40 of the tree of nodes.
+ * The index 0 is the black nil leaf shared by all nodes like in CLRS,
+ * deleted nodes are reused before the arrays grow.
+ */
+template <class Key, class Compare = std::less<Key>>
+class CompactRedBlackTree : private Compare
+{
+public:
+    typedef uint32_t Index;
+
+    CompactRedBlackTree(const Compare& compare = Compare());
+
+    bool Insert(const Key& key);
+
+    void Delete(const Key& key);
+
+    bool Find(const Key& key);
+
+    Key KMin(int k);
+
+    int Size() const {return size;}
+
+    void Reserve(size_t count);
+
+    void Clear();
+
+    // Structure of the tree, the nil leaf is the index 0
+    Index Root() const {return root;}
+    Index LeftChild(Index node) const {return nodes[node].left;}
+    Index RightChild(Index node) const {return nodes[node].right;}
+    Index Parent(Index node) const {return parentColors[node] & indexMask;}
+    ColorType Color(Index node) const {return parentColors[node] & redBit? RED : BLACK;}
+    const Key& KeyOf(Index node) const {return nodes[node].key;}
+
+#ifdef RB_TREE_STATS
+    // Rotations since the construction, counted by the builds measuring the tree
+    size_t Rotations() const {return rotations;}
+#endif
+
+private:
+    // Fields of the descents by keys and by ranks
+    struct CompactNode {
+        Key key;
+        Index left;
+        Index right;
+        int quantityLeftNodes;
+    };
+
+    enum : Index { nil = 0, redBit = Index(1) << 31, indexMask = redBit - 1 };
+
+    bool Less(const Key& a, const Key& b) const {return static_cast<const Compare&>(*this)(a, b);}
+
+    bool IsRed(Index node) const {return parentColors[node] & redBit;}
+
+    void SetColor(Index node, ColorType color);
+
+    void SetParent(Index node, Index parent);
+
+    Index FindIndex(const Key& key);
+
+    Index NewNode(const Key& key, Index parent);
+
+    void RotateLeft(Index node);
+
+    void RotateRight(Index node);
+
+    void Transplant(Index node, Index replacement);
+
+    void FixUpInsert(Index node);
+
+    void FixUpDelete(Index node);
+
+    void FixLeftNodesQuantity(Index node);
+
+    std::vector<CompactNode> nodes;
+    std::vector<Index> parentColors;
+    Index root;
+    Index freeList;
+    int size;
+
+#ifdef RB_TREE_STATS
+    size_t rotations;
+#endif
+};
+
+template <class Key, class Compare>
+CompactRedBlackTree<Key, Compare>::CompactRedBlackTree(const Compare& compare) : Compare(compare)
+{
+#ifdef RB_TREE_STATS
+    rotations = 0;
+#endif
+    Clear();
+}
+
+/**
+ * Insert the key in one descent, left counts are increased on the way down
+ * and returned back for a duplicate
+ *
+ * @param  {Key} key : Desired key
+ * @return {bool}    : False if the key was already there
+ */
+template <class Key, class Compare>
+bool CompactRedBlackTree<Key, Compare>::Insert(const Key& key)
+{
+    Index parent = nil;
+    Index node = root;
+
+    while (node != nil)
+    {
+        parent = node;
+        if (Less(key, nodes[node].key)){
+            nodes[node].quantityLeftNodes++;
+            node = nodes[node].left;
+        } else if (Less(nodes[node].key, key))
+            node = nodes[node].right;
+        else {
+            FixLeftNodesQuantity(node);
+            return false;
+        }
+    }
+
+    node = NewNode(key, parent);
+    if (parent == nil)
+        root = node;
+    else if (Less(key, nodes[parent].key))
+        nodes[parent].left = node;
+    else
+        nodes[parent].right = node;
+
+    FixUpInsert(node);
+    size++;
+    return true;
+}
+
+/**
+ * Delete the key. A node with two children takes the key of its successor
+ * and the successor is removed instead.
+ *
+ * @param  {Key} key : Desired key
+ */
+template <class Key, class Compare>
+void CompactRedBlackTree<Key, Compare>::Delete(const Key& key)
+{
+    Index node = FindIndex(key);
+
+    if (node == nil)
+        return;
+
+    if (nodes[node].left != nil && nodes[node].right != nil){
+        Index successor = nodes[node].right;
+        while (nodes[successor].left != nil)
+            successor = nodes[successor].left;
+        nodes[node].key = nodes[successor].key;
+        node = successor;
+    }
+
+    FixLeftNodesQuantity(node);
+
+    // The nil leaf gets the parent too, the fix up starts from it
+    Index child = nodes[node].left != nil? nodes[node].left : nodes[node].right;
+    Transplant(node, child);
+    if (!IsRed(node))
+        FixUpDelete(child);
+
+    nodes[node].left = freeList;
+    freeList = node;
+    size--;
+}
+
+/**
+ * Find the key
+ *
+ * @param  {Key} key : Desired key
+ * @return {bool}    : Return false if not found
+ */
+template <class Key, class Compare>
+bool CompactRedBlackTree<Key, Compare>::Find(const Key& key)
+{
+    return FindIndex(key) != nil;
+}
+
+/**
+ * Return the Kth minimum key
+ *
+ * @param  {int} k  : Index number
+ * @return {Key}    : The Kth minimum key, the maximal value of the key type if k is out of range
+ */
+template <class Key, class Compare>
+Key CompactRedBlackTree<Key, Compare>::KMin(int k)
+{
+    if (k < 1 || k > size)
+        return std::numeric_limits<Key>::max();
+
+    Index node = root;
+    while (k != nodes[node].quantityLeftNodes + 1)
+    {
+        if (k <= nodes[node].quantityLeftNodes)
+            node = nodes[node].left;
+        else {
+            k -= nodes[node].quantityLeftNodes + 1;
+            node = nodes[node].right;
+        }
+    }
+    return nodes[node].key;
+}
+
+/**
+ * Allocate the arrays for the given number of keys
+ *
+ * @param  {size_t} count : Number of keys
+ */
+template <class Key, class Compare>
+void CompactRedBlackTree<Key, Compare>::Reserve(size_t count)
+{
+    nodes.reserve(count + 1);
+    parentColors.reserve(count + 1);
+}
+
+/**
+ * Delete all nodes, the arrays keep their capacity
+ *
+ */
+template <class Key, class Compare>
+void CompactRedBlackTree<Key, Compare>::Clear()
+{
+    nodes.resize(1);
+    parentColors.resize(1);
+    nodes[nil] = CompactNode{Key(), nil, nil, 0};
+    parentColors[nil] = nil;
+    root = freeList = nil;
+    size = 0;
+}
+
+template <class Key, class Compare>
+void CompactRedBlackTree<Key, Compare>::SetColor(Index node, ColorType color)
+{
+    if (color == RED)
+        parentColors[node] |= redBit;
+    else
+        parentColors[node] &= indexMask;
+}
+
+template <class Key, class Compare>
+void CompactRedBlackTree<Key, Compare>::SetParent(Index node, Index parent)
+{
+    parentColors[node] = (parentColors[node] & redBit) | parent;
+}
+
+/**
+ * Find an index of the node with the given key
+ *
+ * @param  {Key} key : Key
+ * @return {Index}   : Node with the same key, nil if not found
+ */
+template <class Key, class Compare>
+typename CompactRedBlackTree<Key, Compare>::Index CompactRedBlackTree<Key, Compare>::FindIndex(const Key& key)
+{
+    Index node = root;
+    while (node != nil && (Less(key, nodes[node].key) | Less(nodes[node].key, key)))
+        node = Less(key, nodes[node].key)? nodes[node].left : nodes[node].right;
+
+    return node;
+}
+
+/**
+ * Red leaf from the free list or from the end of the array
+ *
+ * @param  {Key} key      : Key of the node
+ * @param  {Index} parent : Parent of the node
+ * @return {Index}        : New node
+ */
+template <class Key, class Compare>
+typename CompactRedBlackTree<Key, Compare>::Index CompactRedBlackTree<Key, Compare>::NewNode(const Key& key, Index parent)
+{
+    CompactNode node = {key, nil, nil, 0};
+
+    if (freeList != nil){
+        Index index = freeList;
+        freeList = nodes[index].left;
+        nodes[index] = node;
+        parentColors[index] = parent | redBit;
+        return index;
+    }
+
+    if (nodes.size() > indexMask)
+        throw std::length_error("CompactRedBlackTree: too many nodes for 31-bit indices");
+
+    nodes.push_back(node);
+    parentColors.push_back(parent | redBit);
+    return nodes.size() - 1;
+}
+
+/**
+ * Rotate the node down to the left, its right child takes its place
+ *
+ * @param  {Index} node : Node with the right child
+ */
+template <class Key, class Compare>
+void CompactRedBlackTree<Key, Compare>::RotateLeft(Index node)
+{
+#ifdef RB_TREE_STATS
+    rotations++;
+#endif
+    Index child = nodes[node].right;
+
+    nodes[node].right = nodes[child].left;
+    if (nodes[child].left != nil)
+        SetParent(nodes[child].left, node);
+
+    Transplant(node, child);
+    nodes[child].left = node;
+    SetParent(node, child);
+    nodes[child].quantityLeftNodes += nodes[node].quantityLeftNodes + 1;
+}
+
+/**
+ * Rotate the node down to the right, its left child takes its place
+ *
+ * @param  {Index} node : Node with the left child
+ */
+template <class Key, class Compare>
+void CompactRedBlackTree<Key, Compare>::RotateRight(Index node)
+{
+#ifdef RB_TREE_STATS
+    rotations++;
+#endif
+    Index child = nodes[node].left;
+
+    nodes[node].left = nodes[child].right;
+    if (nodes[child].right != nil)
+        SetParent(nodes[child].right, node);
+
+    Transplant(node, child);
+    nodes[child].right = node;
+    SetParent(node, child);
+    nodes[node].quantityLeftNodes -= nodes[child].quantityLeftNodes + 1;
+}
+
+/**
+ * Put the replacement to the place of the node under its parent
+ *
+ * @param  {Index} node        : Original node
+ * @param  {Index} replacement : Node taking the place, can be nil
+ */
+template <class Key, class Compare>
+void CompactRedBlackTree<Key, Compare>::Transplant(Index node, Index replacement)
+{
+    Index parent = Parent(node);
+
+    if (parent == nil)
+        root = replacement;
+    else if (node == nodes[parent].left)
+        nodes[parent].left = replacement;
+    else
+        nodes[parent].right = replacement;
+
+    SetParent(replacement, parent);
+}
+
+/**
+ * Fix up the tree after insertion (down up)
+ *
+ * @param  {Index} node : Red node to fix up
+ */
+template <class Key, class Compare>
+void CompactRedBlackTree<Key, Compare>::FixUpInsert(Index node)
+{
+    while (IsRed(Parent(node)))
+    {
+        Index parent = Parent(node);
+        Index grandparent = Parent(parent);
+        bool left = parent == nodes[grandparent].left;
+        Index uncle = left? nodes[grandparent].right : nodes[grandparent].left;
+
+        // Red uncle case
+        if (IsRed(uncle)){
+            SetColor(parent, BLACK);
+            SetColor(uncle, BLACK);
+            SetColor(grandparent, RED);
+            node = grandparent;
+            continue;
+        }
+
+        // Red nodes in triangle case, the parent becomes the lower node
+        if (left && node == nodes[parent].right){
+            RotateLeft(parent);
+            std::swap(node, parent);
+        } else if (!left && node == nodes[parent].left){
+            RotateRight(parent);
+            std::swap(node, parent);
+        }
+
+        // Red nodes in line case
+        SetColor(parent, BLACK);
+        SetColor(grandparent, RED);
+        if (left)
+            RotateRight(grandparent);
+        else
+            RotateLeft(grandparent);
+    }
+    SetColor(root, BLACK);
+}
+
+/**
+ * Fix up the tree after deletion (down up)
+ *
+ * @param  {Index} node : Node with the extra black, can be nil
+ */
+template <class Key, class Compare>
+void CompactRedBlackTree<Key, Compare>::FixUpDelete(Index node)
+{
+    while (node != root && !IsRed(node))
+    {
+        Index parent = Parent(node);
+        bool left = node == nodes[parent].left;
+        Index sibling = left? nodes[parent].right : nodes[parent].left;
+
+        // Red sibling is rotated above the parent
+        if (IsRed(sibling)){
+            SetColor(sibling, BLACK);
+            SetColor(parent, RED);
+            if (left)
+                RotateLeft(parent);
+            else
+                RotateRight(parent);
+            sibling = left? nodes[parent].right : nodes[parent].left;
+        }
+
+        Index near = left? nodes[sibling].left : nodes[sibling].right;
+        Index far = left? nodes[sibling].right : nodes[sibling].left;
+
+        // Black nephews, the extra black moves up
+        if (!IsRed(near) && !IsRed(far)){
+            SetColor(sibling, RED);
+            node = parent;
+            continue;
+        }
+
+        // Red near nephew is rotated to the far side
+        if (!IsRed(far)){
+            SetColor(near, BLACK);
+            SetColor(sibling, RED);
+            if (left)
+                RotateRight(sibling);
+            else
+                RotateLeft(sibling);
+            far = sibling;
+            sibling = near;
+        }
+
+        SetColor(sibling, Color(parent));
+        SetColor(parent, BLACK);
+        SetColor(far, BLACK);
+        if (left)
+            RotateLeft(parent);
+        else
+            RotateRight(parent);
+        node = root;
+    }
+    SetColor(node, BLACK);
+}
+
+/**
+ * Decrease left counts of the ancestors which have the node in the left subtree
+ *
+ * @param  {Index} node : Node leaving the tree
+ */
+template <class Key, class Compare>
+void CompactRedBlackTree<Key, Compare>::FixLeftNodesQuantity(Index node)
+{
+    for (Index parent = Parent(node); parent != nil; node = parent, parent = Parent(node))
+        if (node == nodes[parent].left)
+            nodes[parent].quantityLeftNodes--;
+}
+
+#endif // __COMPACT_RB_TREE_H__
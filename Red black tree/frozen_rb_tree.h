@@ -0,0 +1,209 @@
+#ifndef __FROZEN_RB_TREE_H__
+#define __FROZEN_RB_TREE_H__
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include <limits>
+#include <functional>
+#include <algorithm>
+
+/**
+ * Read-only snapshot of the keys of a tree in the Eytzinger (BFS) layout:
+ * the children of the position i are 2i and 2i + 1. The descents compare
+ * without branches and prefetch the cache line of the descendants four levels
+ * down for int keys, left counts in an array parallel to the keys give the ranks.
+ * The arrays start at cache lines, so the prefetched descendants share one line.
+ * RedBlackTree::Freeze() rebuilds the snapshot in one in-order pass
+ * reusing its arrays.
+ */
+class RedBlackTreeTester;
+
+template <class Key, class Compare = std::less<Key>>
+class FrozenRedBlackTree : private Compare
+{
+    friend class RedBlackTreeTester;
+public:
+    FrozenRedBlackTree(const Compare& compare = Compare());
+
+    template <class NodeIterator>
+    void Build(NodeIterator first, int count);
+
+    bool Find(const Key& key) const;
+
+    Key KMin(int k) const;
+
+    int Rank(const Key& key) const;
+
+    int Size() const {return size;}
+
+private:
+    bool Less(const Key& a, const Key& b) const {return static_cast<const Compare&>(*this)(a, b);}
+
+    enum : size_t { cacheLine = 64 };
+
+    // Largest power of two of the keys in a cache line
+    static constexpr size_t PrefetchStride(size_t stride = 1)
+    {
+        return 2 * stride * sizeof(Key) <= cacheLine? PrefetchStride(2 * stride) : stride;
+    }
+
+    // Storage of the arrays starting at a cache line
+    template <class T>
+    struct CacheLineAllocator
+    {
+        typedef T value_type;
+        template <class U> struct rebind {typedef CacheLineAllocator<U> other;};
+
+        CacheLineAllocator() {}
+        template <class U> CacheLineAllocator(const CacheLineAllocator<U>&) {}
+
+        T* allocate(size_t count)
+        {
+            void* memory;
+            if (posix_memalign(&memory, cacheLine, count * sizeof(T)))
+                throw std::bad_alloc();
+            return static_cast<T*>(memory);
+        }
+        void deallocate(T* memory, size_t) {free(memory);}
+
+        template <class U> bool operator==(const CacheLineAllocator<U>&) const {return true;}
+        template <class U> bool operator!=(const CacheLineAllocator<U>&) const {return false;}
+    };
+
+    template <class NodeIterator>
+    int Fill(NodeIterator& node, size_t position);
+
+    size_t LowerBound(const Key& key) const;
+
+    // Position 0 is unused. The prefetched descendants of the position p start at
+    // PrefetchStride() * p, a multiple of the cache line in bytes, and fill one line
+    std::vector<Key, CacheLineAllocator<Key>> keys;
+    std::vector<int, CacheLineAllocator<int>> quantityLeftNodes;
+    int size;
+};
+
+template <class Key, class Compare>
+FrozenRedBlackTree<Key, Compare>::FrozenRedBlackTree(const Compare& compare) : Compare(compare), keys(1), quantityLeftNodes(1), size(0)
+{
+}
+
+/**
+ * Replace the snapshot by the keys of the in-order nodes
+ *
+ * @param  {NodeIterator} first : Iterator of the minimal node, the nodes have the field key
+ * @param  {int} count          : Number of the nodes
+ */
+template <class Key, class Compare>
+template <class NodeIterator>
+void FrozenRedBlackTree<Key, Compare>::Build(NodeIterator first, int count)
+{
+    size = count;
+    keys.resize(count + 1);
+    quantityLeftNodes.resize(count + 1);
+    Fill(first, 1);
+}
+
+/**
+ * Find the key
+ *
+ * @param  {Key} key : Desired key
+ * @return {bool}    : Return false if not found
+ */
+template <class Key, class Compare>
+bool FrozenRedBlackTree<Key, Compare>::Find(const Key& key) const
+{
+    size_t position = LowerBound(key);
+    return position && !Less(key, keys[position]);
+}
+
+/**
+ * Return the Kth minimum key
+ *
+ * @param  {int} k  : Index number
+ * @return {Key}    : The Kth minimum key, the maximal value of the key type if k is out of range
+ */
+template <class Key, class Compare>
+Key FrozenRedBlackTree<Key, Compare>::KMin(int k) const
+{
+    if (k < 1 || k > size)
+        return std::numeric_limits<Key>::max();
+
+    size_t position = 1;
+    while (k != quantityLeftNodes[position] + 1)
+    {
+        if (k <= quantityLeftNodes[position])
+            position = 2 * position;
+        else {
+            k -= quantityLeftNodes[position] + 1;
+            position = 2 * position + 1;
+        }
+    }
+    return keys[position];
+}
+
+/**
+ * Position of the key in the sorted keys like RedBlackTree::Rank
+ *
+ * @param  {Key} key : Desired key
+ * @return {int}     : Position starting at 1
+ */
+template <class Key, class Compare>
+int FrozenRedBlackTree<Key, Compare>::Rank(const Key& key) const
+{
+    int less = 0;
+
+    for (size_t position = 1; position <= size_t(size); )
+    {
+        bool right = Less(keys[position], key);
+        less += right * (quantityLeftNodes[position] + 1);
+        position = 2 * position + right;
+    }
+    return less + 1;
+}
+
+/**
+ * Fill the subtree of the position in order
+ *
+ * @param  {NodeIterator} node : Next node in order
+ * @param  {size_t} position   : Root of the subtree
+ * @return {int}               : Number of the keys of the subtree
+ */
+template <class Key, class Compare>
+template <class NodeIterator>
+int FrozenRedBlackTree<Key, Compare>::Fill(NodeIterator& node, size_t position)
+{
+    if (position > size_t(size))
+        return 0;
+
+    int left = Fill(node, 2 * position);
+    keys[position] = node->key;
+    quantityLeftNodes[position] = left;
+    ++node;
+
+    return left + 1 + Fill(node, 2 * position + 1);
+}
+
+/**
+ * Position of the minimal key not less than the given one. The descent goes
+ * to the bottom without branches, the last left turn is the lower bound.
+ *
+ * @param  {Key} key  : Searched key
+ * @return {size_t}   : Position of the lower bound, 0 if all keys are less
+ */
+template <class Key, class Compare>
+size_t FrozenRedBlackTree<Key, Compare>::LowerBound(const Key& key) const
+{
+    size_t position = 1;
+
+    while (position <= size_t(size))
+    {
+        // The descendants of the last levels are past the end, the index is clamped to stay in the array
+        __builtin_prefetch(keys.data() + std::min(PrefetchStride() * position, keys.size() - 1));
+        position = 2 * position + Less(keys[position], key);
+    }
+    return position >> __builtin_ffsll(~position);
+}
+
+#endif // __FROZEN_RB_TREE_H__
@@ -1,23 +1,59 @@
 #ifndef __NODE_H__
 #define __NODE_H__
 
+#include <type_traits>
+#include <utility>
+
 enum ColorType { BLACK, RED };
 
+// Value type of the trees without mapped values
+struct NoValue {};
+
+template <class Key, class Value, class Compare>
 class RedBlackTree;
 
-class Node
+/**
+ * Storage of the mapped value,
+ * empty values are a base class and take no space in the node
+ */
+template <class Value, bool Empty = std::is_empty<Value>::value>
+class ValueStorage
+{
+public:
+    template <class... Args>
+    ValueStorage(Args&&... args) : value(std::forward<Args>(args)...) {}
+
+    Value& Get() {return value;}
+private:
+    Value value;
+};
+
+template <class Value>
+class ValueStorage<Value, true> : private Value
+{
+public:
+    template <class... Args>
+    ValueStorage(Args&&... args) : Value(std::forward<Args>(args)...) {}
+
+    Value& Get() {return *this;}
+};
+
+template <class Key, class Value = NoValue>
+class Node : private ValueStorage<Value>
 {
+    template <class K, class V, class C>
     friend class RedBlackTree;
-public: 
-    int key;
-    Node();
-    Node(int key, ColorType color, Node* parent, Node* left, Node* right);
-    ~Node();
+public:
+    Key key;
+
+    template <class K, class... Args>
+    Node(ColorType color, Node* parent, K&& key, Args&&... args);
 
     Node* Parent() {return parent;}
     Node* LeftChild() {return left;}
     Node* RightChild() {return right;}
     ColorType Color() {return color;}
+    Value& MappedValue() {return ValueStorage<Value>::Get();}
     Node* Uncle();
     Node* Sibling();
 private:
@@ -28,23 +64,20 @@ private:
     ColorType color;
 };
 
-Node::Node(int key, ColorType color, Node* parent=nullptr, Node* left=nullptr, Node* right=nullptr)
+template <class Key, class Value>
+template <class K, class... Args>
+Node<Key, Value>::Node(ColorType color, Node* parent, K&& key, Args&&... args) :
+        ValueStorage<Value>(std::forward<Args>(args)...), key(std::forward<K>(key))
 {
-    this->key = key;
     this->parent = parent;
-    this->left = left;
-    this->right = right;
+    this->left = nullptr;
+    this->right = nullptr;
     this->color = color;
-    if (left) left->parent = this;
-    if (right) right->parent = this;
     quantityLeftNodes = 0;
 }
 
-Node::~Node()
-{
-}
-
-Node* Node::Uncle() 
+template <class Key, class Value>
+Node<Key, Value>* Node<Key, Value>::Uncle()
 {
     if (!this->parent)
         return nullptr;
@@ -52,14 +85,15 @@ Node* Node::Uncle()
     return this->parent->Sibling();
 }
 
-Node* Node::Sibling() 
+template <class Key, class Value>
+Node<Key, Value>* Node<Key, Value>::Sibling()
 {
     if (!this->parent)
         return nullptr;
-    
+
     if (this->parent->left == this)
         return this->parent->right;
-    else 
+    else
         return this->parent->left;
 }
-#endif // __NODE_H__
\ No newline at end of file
+#endif // __NODE_H__
@@ -0,0 +1,173 @@
+#ifndef __NODE_POOL_H__
+#define __NODE_POOL_H__
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Arena of tree nodes. Nodes are carved from contiguous blocks,
+ * released nodes are linked in the free list stored inside their slots
+ * and reused before the next block is touched.
+ * Clear() only drops the blocks, the owner destroys the nodes 
+ * which are not trivially destructible before.
+ * Trees which exchange nodes share their blocks, a block is freed 
+ * when the last pool holding it drops it. The free slots move with the
+ * blocks to the pool receiving the nodes.
+ */
+template <class T>
+class NodePool
+{
+public:
+    NodePool();
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+
+    template <class... Args>
+    T* Allocate(Args&&... args);
+
+    T* AllocateBlock(size_t count);
+
+    void Release(T* node);
+
+    void Share(NodePool& other);
+
+    void Clear();
+
+    size_t Blocks() const {return blocks.size();}
+
+private:
+    union Slot {
+        Slot* next;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+
+    // Blocks grow twice up to the maximal size
+    enum : size_t { firstBlockSize = 64, maxBlockSize = 1 << 16 };
+
+    // The last block is the one being carved
+    std::vector<std::shared_ptr<Slot>> blocks;
+    size_t blockSize;
+    size_t used;
+    Slot* freeList;
+    // Last slot of the free list, valid while the list is not empty
+    Slot* freeTail;
+};
+
+template <class T>
+NodePool<T>::NodePool() : blockSize(0), used(0), freeList(nullptr), freeTail(nullptr)
+{
+}
+
+/**
+ * Construct new node in a free slot
+ *
+ * @param  {Args} args : Arguments of the node constructor
+ * @return {T*}        : New node
+ */
+template <class T>
+template <class... Args>
+T* NodePool<T>::Allocate(Args&&... args)
+{
+    Slot* slot;
+
+    if (freeList){
+        slot = freeList;
+        freeList = freeList->next;
+    } else {
+        if (used == blockSize){
+            blockSize = blockSize? std::min<size_t>(2 * blockSize, maxBlockSize) : firstBlockSize;
+            blocks.emplace_back(new Slot[blockSize], std::default_delete<Slot[]>());
+            used = 0;
+        }
+        slot = blocks.back().get() + used++;
+    }
+
+    return new (&slot->storage) T(std::forward<Args>(args)...);
+}
+
+/**
+ * Storage for the given number of consecutive nodes in a new block,
+ * the caller constructs the nodes with the placement new.
+ * The block being carved stays the last one, its rest is still used
+ *
+ * @param  {size_t} count : Number of nodes
+ * @return {T*}           : Storage of the first node
+ */
+template <class T>
+T* NodePool<T>::AllocateBlock(size_t count)
+{
+    static_assert(sizeof(Slot) == sizeof(T), "nodes of the block are not consecutive");
+
+    std::shared_ptr<Slot> block(new Slot[count], std::default_delete<Slot[]>());
+    blocks.insert(blocks.empty()? blocks.end() : blocks.end() - 1, block);
+
+    return reinterpret_cast<T*>(block.get());
+}
+
+/**
+ * Destroy the node and return it to the free list
+ *
+ * @param  {T*} node : Node allocated by this pool
+ */
+template <class T>
+void NodePool<T>::Release(T* node)
+{
+    node->~T();
+
+    Slot* slot = reinterpret_cast<Slot*>(node);
+    if (!freeList)
+        freeTail = slot;
+    slot->next = freeList;
+    freeList = slot;
+}
+
+/**
+ * Hold the blocks of the other pool too, so nodes allocated by it
+ * can be moved to the owner of this pool and released here.
+ * The free slots of the other pool are spliced to the free list of this one
+ *
+ * @param  {NodePool} other : Pool of the tree giving the nodes
+ */
+template <class T>
+void NodePool<T>::Share(NodePool& other)
+{
+    if (other.blocks.empty() || &other == this)
+        return;
+
+    std::shared_ptr<Slot> current = blocks.empty()? nullptr : blocks.back();
+
+    blocks.insert(blocks.end(), other.blocks.begin(), other.blocks.end());
+    std::sort(blocks.begin(), blocks.end());
+    blocks.erase(std::unique(blocks.begin(), blocks.end()), blocks.end());
+
+    // Without an own block the next allocation starts a new one
+    if (current)
+        std::swap(*std::find(blocks.begin(), blocks.end(), current), blocks.back());
+
+    if (other.freeList){
+        other.freeTail->next = freeList;
+        if (!freeList)
+            freeTail = other.freeTail;
+        freeList = other.freeList;
+        other.freeList = other.freeTail = nullptr;
+    }
+}
+
+/**
+ * Release all nodes at once, the blocks are freed without visiting the nodes
+ *
+ */
+template <class T>
+void NodePool<T>::Clear()
+{
+    blocks.clear();
+    blockSize = used = 0;
+    freeList = freeTail = nullptr;
+}
+
+#endif // __NODE_POOL_H__
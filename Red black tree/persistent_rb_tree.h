@@ -0,0 +1,593 @@
+#ifndef __PERSISTENT_RB_TREE_H__
+#define __PERSISTENT_RB_TREE_H__
+
+#include "node.h"
+#include "node_pool.h"
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+/**
+ * Red black tree of unique keys with immutable nodes. An update copies
+ * the path from the changed node to the root and publishes the new root,
+ * the untouched subtrees are shared with the previous version.
+ * A snapshot is a root handle, readers query it without locks while
+ * the writers (serialized by a mutex) publish the next versions.
+ * The insertion and the deletion are the functional algorithms
+ * of Okasaki and Kahrs as verified in Isabelle's RBT.
+ *
+ * Nodes replaced by an update are retired with the epoch of the update.
+ * Every reader owns a slot where it announces the epoch it started in,
+ * a retired node is freed when all busy slots have a later epoch.
+ */
+template <class Key, class Compare = std::less<Key>>
+class PersistentRedBlackTree : private Compare
+{
+public:
+    struct PersistentNode {
+        Key key;
+        const PersistentNode* left;
+        const PersistentNode* right;
+        int size;
+        int quantityLeftNodes;
+        ColorType color;
+
+        PersistentNode(ColorType color, const PersistentNode* left, const Key& key, const PersistentNode* right);
+    };
+
+    /**
+     * Version of the tree pinned in a reader slot until destroyed.
+     * A slot holds one snapshot at a time, Read() throws while it is busy.
+     */
+    class Snapshot
+    {
+    public:
+        Snapshot(Snapshot&& other);
+        Snapshot(const Snapshot&) = delete;
+        Snapshot& operator=(const Snapshot&) = delete;
+        ~Snapshot();
+
+        bool Find(const Key& key) const;
+
+        Key KMin(int k) const;
+
+        int Size() const {return root? root->size : 0;}
+
+        const PersistentNode* Root() const {return root;}
+
+    private:
+        friend class PersistentRedBlackTree;
+
+        Snapshot(const PersistentRedBlackTree* tree, int reader, const PersistentNode* root);
+
+        const PersistentRedBlackTree* tree;
+        int reader;
+        const PersistentNode* root;
+    };
+
+    PersistentRedBlackTree(int readers, const Compare& compare = Compare());
+    PersistentRedBlackTree(const PersistentRedBlackTree&) = delete;
+    PersistentRedBlackTree& operator=(const PersistentRedBlackTree&) = delete;
+    ~PersistentRedBlackTree();
+
+    Snapshot Read(int reader) const;
+
+    bool Insert(const Key& key);
+
+    void Delete(const Key& key);
+
+private:
+    typedef const PersistentNode* Link;
+
+    // Epoch of the slots without a snapshot
+    static constexpr uint64_t idle = std::numeric_limits<uint64_t>::max();
+
+    // Slots of the readers take own cache lines
+    struct ReaderSlot {
+        std::atomic<uint64_t> epoch;
+        char padding[64 - sizeof(std::atomic<uint64_t>)];
+
+        ReaderSlot() : epoch(idle) {}
+    };
+
+    // Nodes retired by the update of the epoch
+    struct RetiredNodes {
+        uint64_t epoch;
+        std::vector<Link> nodes;
+    };
+
+    bool Less(const Key& a, const Key& b) const {return static_cast<const Compare&>(*this)(a, b);}
+
+    static bool IsRed(Link node) {return node && node->color == RED;}
+
+    static bool IsBlack(Link node) {return node && node->color == BLACK;}
+
+    bool Find(Link node, const Key& key) const;
+
+    Link Make(ColorType color, Link left, const Key& key, Link right);
+
+    void Retire(Link node) {retired.push_back(node);}
+
+    Link Paint(Link node, ColorType color);
+
+    Link InsertInto(Link node, const Key& key);
+
+    Link DeleteFrom(Link node, const Key& key);
+
+    Link BalanceLeft(Link left, const Key& key, Link right);
+
+    Link BalanceRight(Link left, const Key& key, Link right);
+
+    Link BalanceDeletedLeft(Link left, const Key& key, Link right);
+
+    Link BalanceDeletedRight(Link left, const Key& key, Link right);
+
+    Link Fuse(Link left, Link right);
+
+    void Publish(Link next);
+
+    void Reclaim();
+
+    void Destroy(Link node);
+
+    std::atomic<Link> root;
+    std::atomic<uint64_t> epoch;
+    std::unique_ptr<ReaderSlot[]> slots;
+    int readers;
+
+    // State of the writers
+    std::mutex writer;
+    NodePool<PersistentNode> pool;
+    std::vector<Link> retired;
+    std::deque<RetiredNodes> limbo;
+};
+
+template <class Key, class Compare>
+constexpr uint64_t PersistentRedBlackTree<Key, Compare>::idle;
+
+template <class Key, class Compare>
+PersistentRedBlackTree<Key, Compare>::PersistentNode::PersistentNode(ColorType color, const PersistentNode* left,
+        const Key& key, const PersistentNode* right) : key(key), left(left), right(right), color(color)
+{
+    quantityLeftNodes = left? left->size : 0;
+    size = quantityLeftNodes + 1 + (right? right->size : 0);
+}
+
+template <class Key, class Compare>
+PersistentRedBlackTree<Key, Compare>::Snapshot::Snapshot(const PersistentRedBlackTree* tree, int reader, const PersistentNode* root) :
+        tree(tree), reader(reader), root(root)
+{
+}
+
+template <class Key, class Compare>
+PersistentRedBlackTree<Key, Compare>::Snapshot::Snapshot(Snapshot&& other) : tree(other.tree), reader(other.reader), root(other.root)
+{
+    other.tree = nullptr;
+}
+
+template <class Key, class Compare>
+PersistentRedBlackTree<Key, Compare>::Snapshot::~Snapshot()
+{
+    if (tree)
+        tree->slots[reader].epoch.store(idle);
+}
+
+/**
+ * Find the key in the snapshot
+ *
+ * @param  {Key} key : Desired key
+ * @return {bool}    : Return false if not found
+ */
+template <class Key, class Compare>
+bool PersistentRedBlackTree<Key, Compare>::Snapshot::Find(const Key& key) const
+{
+    return tree->Find(root, key);
+}
+
+/**
+ * Return the Kth minimum key of the snapshot
+ *
+ * @param  {int} k  : Index number
+ * @return {Key}    : The Kth minimum key, the maximal value of the key type if k is out of range
+ */
+template <class Key, class Compare>
+Key PersistentRedBlackTree<Key, Compare>::Snapshot::KMin(int k) const
+{
+    if (k < 1 || k > Size())
+        return std::numeric_limits<Key>::max();
+
+    Link node = root;
+    while (k != node->quantityLeftNodes + 1)
+    {
+        if (k <= node->quantityLeftNodes)
+            node = node->left;
+        else {
+            k -= node->quantityLeftNodes + 1;
+            node = node->right;
+        }
+    }
+    return node->key;
+}
+
+/**
+ * Tree with the given number of reader slots
+ *
+ * @param  {int} readers         : Number of the threads reading at the same time
+ * @param  {Compare} compare     : Order of the keys
+ */
+template <class Key, class Compare>
+PersistentRedBlackTree<Key, Compare>::PersistentRedBlackTree(int readers, const Compare& compare) :
+        Compare(compare), root(nullptr), epoch(0), slots(new ReaderSlot[readers]), readers(readers)
+{
+}
+
+template <class Key, class Compare>
+PersistentRedBlackTree<Key, Compare>::~PersistentRedBlackTree()
+{
+    if (!std::is_trivially_destructible<Key>::value){
+        Destroy(root.load());
+        for (Link node : retired)
+            pool.Release(const_cast<PersistentNode*>(node));
+        for (RetiredNodes& version : limbo)
+            for (Link node : version.nodes)
+                pool.Release(const_cast<PersistentNode*>(node));
+    }
+    pool.Clear();
+}
+
+/**
+ * Pin the current version in the slot of the reader.
+ * The announced epoch keeps the nodes of the version alive, so the slot
+ * must be free: a newer epoch would release the nodes of its snapshot.
+ *
+ * @param  {int} reader     : Slot of the calling thread, less than the number of readers
+ * @return {Snapshot}       : Current version
+ */
+template <class Key, class Compare>
+typename PersistentRedBlackTree<Key, Compare>::Snapshot PersistentRedBlackTree<Key, Compare>::Read(int reader) const
+{
+    if (slots[reader].epoch.load() != idle)
+        throw std::logic_error("PersistentRedBlackTree: reader slot already holds a snapshot");
+
+    slots[reader].epoch.store(epoch.load());
+    return Snapshot(this, reader, root.load());
+}
+
+/**
+ * Publish the version with the key
+ *
+ * @param  {Key} key : Inserted key
+ * @return {bool}    : Return false if the key is already in the tree
+ */
+template <class Key, class Compare>
+bool PersistentRedBlackTree<Key, Compare>::Insert(const Key& key)
+{
+    std::lock_guard<std::mutex> lock(writer);
+    Link current = root.load(std::memory_order_relaxed);
+
+    if (Find(current, key))
+        return false;
+
+    Publish(Paint(InsertInto(current, key), BLACK));
+    return true;
+}
+
+/**
+ * Publish the version without the key
+ *
+ * @param  {Key} key : Deleted key
+ */
+template <class Key, class Compare>
+void PersistentRedBlackTree<Key, Compare>::Delete(const Key& key)
+{
+    std::lock_guard<std::mutex> lock(writer);
+    Link current = root.load(std::memory_order_relaxed);
+
+    if (!Find(current, key))
+        return;
+
+    Link next = DeleteFrom(current, key);
+    Publish(next? Paint(next, BLACK) : nullptr);
+}
+
+template <class Key, class Compare>
+bool PersistentRedBlackTree<Key, Compare>::Find(Link node, const Key& key) const
+{
+    while (node)
+    {
+        if (Less(key, node->key))
+            node = node->left;
+        else if (Less(node->key, key))
+            node = node->right;
+        else
+            return true;
+    }
+    return false;
+}
+
+template <class Key, class Compare>
+typename PersistentRedBlackTree<Key, Compare>::Link PersistentRedBlackTree<Key, Compare>::Make(ColorType color, Link left, const Key& key, Link right)
+{
+    return pool.Allocate(color, left, key, right);
+}
+
+/**
+ * Node of the given color, the node is copied if it has the other color
+ *
+ * @param  {Link} node        : Not null node
+ * @param  {ColorType} color  : Desired color
+ * @return {Link}             : Node of the color
+ */
+template <class Key, class Compare>
+typename PersistentRedBlackTree<Key, Compare>::Link PersistentRedBlackTree<Key, Compare>::Paint(Link node, ColorType color)
+{
+    if (node->color == color)
+        return node;
+
+    Link painted = Make(color, node->left, node->key, node->right);
+    Retire(node);
+    return painted;
+}
+
+/**
+ * Copy of the subtree with the absent key, the root may be red with a red child
+ * if the subtree root is red
+ *
+ * @param  {Link} node : Root of the subtree
+ * @param  {Key} key   : Inserted key
+ * @return {Link}      : New root
+ */
+template <class Key, class Compare>
+typename PersistentRedBlackTree<Key, Compare>::Link PersistentRedBlackTree<Key, Compare>::InsertInto(Link node, const Key& key)
+{
+    if (!node)
+        return Make(RED, nullptr, key, nullptr);
+
+    Link result;
+    if (Less(key, node->key))
+        result = node->color == BLACK? BalanceLeft(InsertInto(node->left, key), node->key, node->right) :
+                                       Make(RED, InsertInto(node->left, key), node->key, node->right);
+    else
+        result = node->color == BLACK? BalanceRight(node->left, node->key, InsertInto(node->right, key)) :
+                                       Make(RED, node->left, node->key, InsertInto(node->right, key));
+    Retire(node);
+    return result;
+}
+
+/**
+ * Copy of the subtree without the present key. The black height of a subtree
+ * with the black root decreases by one, the root of the result may be red.
+ *
+ * @param  {Link} node : Root of the subtree
+ * @param  {Key} key   : Deleted key
+ * @return {Link}      : New root
+ */
+template <class Key, class Compare>
+typename PersistentRedBlackTree<Key, Compare>::Link PersistentRedBlackTree<Key, Compare>::DeleteFrom(Link node, const Key& key)
+{
+    Link result;
+
+    if (Less(key, node->key))
+        result = IsBlack(node->left)? BalanceDeletedLeft(DeleteFrom(node->left, key), node->key, node->right) :
+                                      Make(RED, DeleteFrom(node->left, key), node->key, node->right);
+    else if (Less(node->key, key))
+        result = IsBlack(node->right)? BalanceDeletedRight(node->left, node->key, DeleteFrom(node->right, key)) :
+                                       Make(RED, node->left, node->key, DeleteFrom(node->right, key));
+    else
+        result = Fuse(node->left, node->right);
+    Retire(node);
+    return result;
+}
+
+/**
+ * Black node of the key, red red violation in the left subtree is rotated up
+ *
+ * @param  {Link} left  : Left subtree
+ * @param  {Key} key    : Key of the node
+ * @param  {Link} right : Right subtree
+ * @return {Link}       : Root of the balanced subtree
+ */
+template <class Key, class Compare>
+typename PersistentRedBlackTree<Key, Compare>::Link PersistentRedBlackTree<Key, Compare>::BalanceLeft(Link left, const Key& key, Link right)
+{
+    Link result;
+
+    if (IsRed(left) && IsRed(left->left)){
+        Link child = left->left;
+        result = Make(RED, Make(BLACK, child->left, child->key, child->right), left->key, Make(BLACK, left->right, key, right));
+        Retire(child);
+        Retire(left);
+    } else if (IsRed(left) && IsRed(left->right)){
+        Link child = left->right;
+        result = Make(RED, Make(BLACK, left->left, left->key, child->left), child->key, Make(BLACK, child->right, key, right));
+        Retire(child);
+        Retire(left);
+    } else
+        result = Make(BLACK, left, key, right);
+    return result;
+}
+
+/**
+ * Black node of the key, red red violation in the right subtree is rotated up
+ *
+ * @param  {Link} left  : Left subtree
+ * @param  {Key} key    : Key of the node
+ * @param  {Link} right : Right subtree
+ * @return {Link}       : Root of the balanced subtree
+ */
+template <class Key, class Compare>
+typename PersistentRedBlackTree<Key, Compare>::Link PersistentRedBlackTree<Key, Compare>::BalanceRight(Link left, const Key& key, Link right)
+{
+    Link result;
+
+    if (IsRed(right) && IsRed(right->right)){
+        Link child = right->right;
+        result = Make(RED, Make(BLACK, left, key, right->left), right->key, Make(BLACK, child->left, child->key, child->right));
+        Retire(child);
+        Retire(right);
+    } else if (IsRed(right) && IsRed(right->left)){
+        Link child = right->left;
+        result = Make(RED, Make(BLACK, left, key, child->left), child->key, Make(BLACK, child->right, right->key, right->right));
+        Retire(child);
+        Retire(right);
+    } else
+        result = Make(BLACK, left, key, right);
+    return result;
+}
+
+/**
+ * Node of the key after the deletion from the left subtree,
+ * the black height of the left subtree is one less than of the right one
+ *
+ * @param  {Link} left  : Left subtree
+ * @param  {Key} key    : Key of the node
+ * @param  {Link} right : Right subtree
+ * @return {Link}       : Root of the subtree
+ */
+template <class Key, class Compare>
+typename PersistentRedBlackTree<Key, Compare>::Link PersistentRedBlackTree<Key, Compare>::BalanceDeletedLeft(Link left, const Key& key, Link right)
+{
+    Link result;
+
+    if (IsRed(left)){
+        result = Make(RED, Make(BLACK, left->left, left->key, left->right), key, right);
+        Retire(left);
+    } else if (IsBlack(right)){
+        result = BalanceRight(left, key, Make(RED, right->left, right->key, right->right));
+        Retire(right);
+    } else if (IsRed(right) && IsBlack(right->left)){
+        Link child = right->left;
+        result = Make(RED, Make(BLACK, left, key, child->left), child->key,
+                      BalanceRight(child->right, right->key, Paint(right->right, RED)));
+        Retire(child);
+        Retire(right);
+    } else
+        result = Make(RED, left, key, right);
+    return result;
+}
+
+/**
+ * Node of the key after the deletion from the right subtree,
+ * the black height of the right subtree is one less than of the left one
+ *
+ * @param  {Link} left  : Left subtree
+ * @param  {Key} key    : Key of the node
+ * @param  {Link} right : Right subtree
+ * @return {Link}       : Root of the subtree
+ */
+template <class Key, class Compare>
+typename PersistentRedBlackTree<Key, Compare>::Link PersistentRedBlackTree<Key, Compare>::BalanceDeletedRight(Link left, const Key& key, Link right)
+{
+    Link result;
+
+    if (IsRed(right)){
+        result = Make(RED, left, key, Make(BLACK, right->left, right->key, right->right));
+        Retire(right);
+    } else if (IsBlack(left)){
+        result = BalanceLeft(Make(RED, left->left, left->key, left->right), key, right);
+        Retire(left);
+    } else if (IsRed(left) && IsBlack(left->right)){
+        Link child = left->right;
+        result = Make(RED, BalanceLeft(Paint(left->left, RED), left->key, child->left), child->key,
+                      Make(BLACK, child->right, key, right));
+        Retire(child);
+        Retire(left);
+    } else
+        result = Make(RED, left, key, right);
+    return result;
+}
+
+/**
+ * Join the children of the deleted node
+ *
+ * @param  {Link} left  : Left child
+ * @param  {Link} right : Right child
+ * @return {Link}       : Root of the joined subtrees
+ */
+template <class Key, class Compare>
+typename PersistentRedBlackTree<Key, Compare>::Link PersistentRedBlackTree<Key, Compare>::Fuse(Link left, Link right)
+{
+    if (!left)
+        return right;
+    if (!right)
+        return left;
+
+    Link result;
+    if (left->color == right->color){
+        Link middle = Fuse(left->right, right->left);
+        if (IsRed(middle)){
+            result = Make(RED, Make(left->color, left->left, left->key, middle->left), middle->key,
+                          Make(left->color, middle->right, right->key, right->right));
+            Retire(middle);
+        } else if (left->color == RED)
+            result = Make(RED, left->left, left->key, Make(RED, middle, right->key, right->right));
+        else
+            result = BalanceDeletedLeft(left->left, left->key, Make(BLACK, middle, right->key, right->right));
+        Retire(left);
+        Retire(right);
+    } else if (right->color == RED){
+        result = Make(RED, Fuse(left, right->left), right->key, right->right);
+        Retire(right);
+    } else {
+        result = Make(RED, left->left, left->key, Fuse(left->right, right));
+        Retire(left);
+    }
+    return result;
+}
+
+/**
+ * Replace the root and retire the nodes of the previous version with the current epoch.
+ * A reader which announced a later epoch loaded the new root.
+ *
+ * @param  {Link} next : Root of the new version
+ */
+template <class Key, class Compare>
+void PersistentRedBlackTree<Key, Compare>::Publish(Link next)
+{
+    root.store(next);
+
+    limbo.push_back(RetiredNodes());
+    limbo.back().epoch = epoch.fetch_add(1);
+    limbo.back().nodes.swap(retired);
+
+    Reclaim();
+}
+
+/**
+ * Free the nodes retired before the oldest epoch announced by the readers
+ *
+ */
+template <class Key, class Compare>
+void PersistentRedBlackTree<Key, Compare>::Reclaim()
+{
+    uint64_t oldest = idle;
+    for (int i = 0; i < readers; i++)
+        oldest = std::min(oldest, slots[i].epoch.load());
+
+    while (!limbo.empty() && limbo.front().epoch < oldest){
+        for (Link node : limbo.front().nodes)
+            pool.Release(const_cast<PersistentNode*>(node));
+        limbo.pop_front();
+    }
+}
+
+template <class Key, class Compare>
+void PersistentRedBlackTree<Key, Compare>::Destroy(Link node)
+{
+    if (!node)
+        return;
+
+    Destroy(node->left);
+    Destroy(node->right);
+    pool.Release(const_cast<PersistentNode*>(node));
+}
+
+#endif // __PERSISTENT_RB_TREE_H__
@@ -0,0 +1,446 @@
+#include "rb_tree.h"
+#include "compact_rb_tree.h"
+#include "persistent_rb_tree.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <malloc.h>
+#include <memory>
+#include <new>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Live heap bytes including the rounding of malloc. The replacements are not inlined,
+// so the compiler does not pair the inlined malloc with the delete expressions.
+static atomic<size_t> heapBytes(0);
+
+__attribute__((noinline)) void* operator new(size_t size)
+{
+    void* memory = malloc(size);
+    if (!memory)
+        throw bad_alloc();
+
+    heapBytes.fetch_add(malloc_usable_size(memory), memory_order_relaxed);
+    return memory;
+}
+
+__attribute__((noinline)) void operator delete(void* memory) noexcept
+{
+    heapBytes.fetch_sub(malloc_usable_size(memory), memory_order_relaxed);
+    free(memory);
+}
+
+struct Options {
+    long long size;
+    long long operations;
+    string workload;
+    int inserts, deletes, finds;
+    unsigned seed;
+    long long vectorLimit;
+};
+
+enum OperationType { INSERT, DELETE, FIND };
+
+struct Operation {
+    OperationType type;
+    int key;
+};
+
+/**
+ * Zipfian ranks by the method of Gray et al. used by YCSB, the rank 0 is the most frequent
+ */
+class ZipfianRanks
+{
+public:
+    ZipfianRanks(long long items, double theta = 0.99);
+
+    long long Next(mt19937_64& random);
+
+private:
+    static double Zeta(long long items, double theta);
+
+    long long items;
+    double theta;
+    double zetaItems;
+    double alpha;
+    double eta;
+};
+
+ZipfianRanks::ZipfianRanks(long long items, double theta) : items(items), theta(theta)
+{
+    zetaItems = Zeta(items, theta);
+    alpha = 1 / (1 - theta);
+    eta = (1 - pow(2.0 / items, 1 - theta)) / (1 - Zeta(2, theta) / zetaItems);
+}
+
+long long ZipfianRanks::Next(mt19937_64& random)
+{
+    double u = uniform_real_distribution<double>(0, 1)(random);
+    double uz = u * zetaItems;
+
+    if (uz < 1)
+        return 0;
+    if (uz < 1 + pow(0.5, theta))
+        return 1;
+    return min(items - 1, (long long)(items * pow(eta * u - eta + 1, alpha)));
+}
+
+/**
+ * Sum of i^-theta for i from 1 to items, the terms after 10^7 are integrated
+ *
+ * @param  {long long} items : Number of the terms
+ * @param  {double} theta    : Skew
+ * @return {double}          : The sum
+ */
+double ZipfianRanks::Zeta(long long items, double theta)
+{
+    const long long exactTerms = 10000000;
+    double sum = 0;
+
+    for (long long i = 1; i <= min(items, exactTerms); i++)
+        sum += pow(double(i), -theta);
+    if (items > exactTerms)
+        sum += (pow(items + 0.5, 1 - theta) - pow(exactTerms + 0.5, 1 - theta)) / (1 - theta);
+    return sum;
+}
+
+/**
+ * Operations of a workload, the same options give the same operations.
+ * Random keys are in [0, 2 * size), the sequential keys and the window move up.
+ *
+ * sequential : inserts append the keys, deletes remove the oldest ones, finds scan the present keys in order
+ * uniform    : uniform random keys
+ * zipf       : Zipfian keys with the skew 0.99, the hot keys are scattered
+ * window     : inserts append the keys, deletes remove the oldest ones, finds hit random present keys
+ */
+class OperationStream
+{
+public:
+    OperationStream(const string& workload, const Options& options);
+
+    int PrefillKey(long long i);
+
+    Operation Next();
+
+private:
+    // Bijection of [0, range) which scatters consecutive numbers
+    int Scramble(long long x) const {return (unsigned long long)x * 2654435761ULL % range;}
+
+    string workload;
+    long long range;
+    int inserts, deletes, total;
+    mt19937_64 random;
+    ZipfianRanks zipf;
+    long long cursor;
+    long long low, high;
+};
+
+OperationStream::OperationStream(const string& workload, const Options& options) :
+        workload(workload), range(2 * options.size), inserts(options.inserts), deletes(options.deletes), total(options.inserts + options.deletes + options.finds),
+        random(options.seed), zipf(workload == "zipf"? range : 2), cursor(0), low(0), high(options.size)
+{
+}
+
+/**
+ * Key of the prefill, the prefill has distinct keys
+ *
+ * @param  {long long} i : Number of the inserted key
+ * @return {int}         : Key
+ */
+int OperationStream::PrefillKey(long long i)
+{
+    if (workload == "sequential" || workload == "window")
+        return i;
+    return Scramble(i);
+}
+
+Operation OperationStream::Next()
+{
+    Operation operation;
+    int type = random() % total;
+
+    operation.type = type < inserts? INSERT : type < inserts + deletes? DELETE : FIND;
+    if (workload == "uniform")
+        operation.key = uniform_int_distribution<long long>(0, range - 1)(random);
+    else if (workload == "zipf")
+        operation.key = Scramble(zipf.Next(random));
+    else if (operation.type == INSERT)
+        operation.key = high++;
+    else if (operation.type == DELETE)
+        operation.key = low < high? low++ : low;
+    else if (workload == "window")
+        operation.key = low < high? low + random() % (high - low) : low;
+    else {
+        // The scan restarts at the oldest key when it passes the newest one or falls behind
+        if (cursor < low || cursor >= high)
+            cursor = low;
+        operation.key = cursor < high? cursor++ : low;
+    }
+    return operation;
+}
+
+// Structures under the common interface, rotations are -1 if not counted
+
+struct RedBlackTreeSubject {
+    static const char* Name() {return "RedBlackTree";}
+    RedBlackTree<int> tree;
+
+    void Insert(int key) {tree.Insert(key);}
+    void Delete(int key) {tree.Delete(key);}
+    bool Find(int key) {return tree.Find(key);}
+    long long Size() {return tree.Size();}
+    long long Rotations() {return tree.Rotations();}
+};
+
+struct CompactRedBlackTreeSubject {
+    static const char* Name() {return "CompactRedBlackTree";}
+    CompactRedBlackTree<int> tree;
+
+    void Insert(int key) {tree.Insert(key);}
+    void Delete(int key) {tree.Delete(key);}
+    bool Find(int key) {return tree.Find(key);}
+    long long Size() {return tree.Size();}
+    long long Rotations() {return tree.Rotations();}
+};
+
+struct PersistentRedBlackTreeSubject {
+    static const char* Name() {return "PersistentRedBlackTree";}
+    PersistentRedBlackTree<int> tree;
+
+    PersistentRedBlackTreeSubject() : tree(1) {}
+
+    void Insert(int key) {tree.Insert(key);}
+    void Delete(int key) {tree.Delete(key);}
+    bool Find(int key) {return tree.Read(0).Find(key);}
+    long long Size() {return tree.Read(0).Size();}
+    long long Rotations() {return -1;}
+};
+
+struct SetSubject {
+    static const char* Name() {return "std::set";}
+    set<int> tree;
+
+    void Insert(int key) {tree.insert(key);}
+    void Delete(int key) {tree.erase(key);}
+    bool Find(int key) {return tree.count(key);}
+    long long Size() {return tree.size();}
+    long long Rotations() {return -1;}
+};
+
+struct SortedVectorSubject {
+    static const char* Name() {return "sorted vector";}
+    vector<int> keys;
+
+    void Insert(int key)
+    {
+        vector<int>::iterator position = lower_bound(keys.begin(), keys.end(), key);
+        if (position == keys.end() || *position != key)
+            keys.insert(position, key);
+    }
+    void Delete(int key)
+    {
+        vector<int>::iterator position = lower_bound(keys.begin(), keys.end(), key);
+        if (position != keys.end() && *position == key)
+            keys.erase(position);
+    }
+    bool Find(int key) {return binary_search(keys.begin(), keys.end(), key);}
+    long long Size() {return keys.size();}
+    long long Rotations() {return -1;}
+};
+
+template <class Subject>
+bool Apply(Subject& subject, const Operation& operation)
+{
+    if (operation.type == INSERT)
+        subject.Insert(operation.key);
+    else if (operation.type == DELETE)
+        subject.Delete(operation.key);
+    else
+        return subject.Find(operation.key);
+    return false;
+}
+
+// Operations are generated in chunks outside of the measured time
+enum { chunkSize = 1 << 16, maxLatencies = 1 << 24 };
+
+double Nanoseconds(chrono::steady_clock::duration duration)
+{
+    return chrono::duration<double, nano>(duration).count();
+}
+
+/**
+ * Run the workload twice on the fresh structure: the first run measures the throughput,
+ * the memory and the rotations, the second one the latencies of the single operations.
+ * The prefill is not measured.
+ *
+ * @param  {string} workload  : Name of the workload
+ * @param  {Options} options  : Size, number of the operations, mix and seed
+ */
+template <class Subject>
+void Run(const string& workload, const Options& options)
+{
+    long long found = 0, rotations = 0, size = 0;
+    double seconds = 0, bytesPerKey = 0;
+    vector<Operation> chunk(chunkSize);
+
+    {
+        size_t heapBefore = heapBytes;
+        unique_ptr<Subject> subject(new Subject());
+        OperationStream stream(workload, options);
+
+        for (long long i = 0; i < options.size; i++)
+            subject->Insert(stream.PrefillKey(i));
+        rotations = subject->Rotations();
+
+        for (long long done = 0; done < options.operations; done += chunkSize){
+            long long count = min<long long>(chunkSize, options.operations - done);
+            for (long long i = 0; i < count; i++)
+                chunk[i] = stream.Next();
+
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            for (long long i = 0; i < count; i++)
+                found += Apply(*subject, chunk[i]);
+            seconds += Nanoseconds(chrono::steady_clock::now() - start) / 1e9;
+        }
+
+        size = subject->Size();
+        rotations = subject->Rotations() < 0? -1 : subject->Rotations() - rotations;
+        bytesPerKey = size? double(heapBytes - heapBefore) / size : 0;
+    }
+
+    // Every step-th operation is timed, at most maxLatencies of them
+    long long step = (options.operations + maxLatencies - 1) / maxLatencies;
+    vector<float> latencies;
+    {
+        unique_ptr<Subject> subject(new Subject());
+        OperationStream stream(workload, options);
+
+        latencies.reserve(options.operations / max(step, 1LL) + 1);
+        for (long long i = 0; i < options.size; i++)
+            subject->Insert(stream.PrefillKey(i));
+
+        for (long long done = 0; done < options.operations; done += chunkSize){
+            long long count = min<long long>(chunkSize, options.operations - done);
+            for (long long i = 0; i < count; i++)
+                chunk[i] = stream.Next();
+
+            for (long long i = 0; i < count; i++){
+                if ((done + i) % step){
+                    Apply(*subject, chunk[i]);
+                    continue;
+                }
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                Apply(*subject, chunk[i]);
+                latencies.push_back(Nanoseconds(chrono::steady_clock::now() - start));
+            }
+        }
+    }
+
+    double percentiles[] = {0.5, 0.99, 0.999};
+    double values[3] = {0, 0, 0};
+    for (int i = 0; i < 3 && !latencies.empty(); i++){
+        vector<float>::iterator position = latencies.begin() + size_t(percentiles[i] * (latencies.size() - 1));
+        nth_element(latencies.begin(), position, latencies.end());
+        values[i] = *position;
+    }
+
+    char rotationsText[32] = "-";
+    if (rotations >= 0)
+        snprintf(rotationsText, sizeof(rotationsText), "%lld", rotations);
+
+    printf("%-11s %-23s %12.0f %9.0f %9.0f %9.0f %10.1f %12s %11lld %11lld\n", workload.c_str(), Subject::Name(),
+           seconds > 0? options.operations / seconds : 0, values[0], values[1], values[2], bytesPerKey, rotationsText, found, size);
+    fflush(stdout);
+}
+
+void PrintUsage()
+{
+    printf("Usage: rb_bench [--size N] [--operations N] [--workload sequential|uniform|zipf|window|all]\n"
+           "                [--mix INSERTS:DELETES:FINDS] [--seed N] [--vector-limit N]\n"
+           "Sizes accept the exponent notation like 1e6. The prefill inserts size keys,\n"
+           "then the measured operations run, by default as many as the size with the mix 1:1:2.\n"
+           "The sorted vector is skipped when the size or the operations exceed the vector limit.\n");
+}
+
+bool ParseOptions(int argc, char const *argv[], Options& options)
+{
+    options.size = 100000;
+    options.operations = -1;
+    options.workload = "all";
+    options.inserts = options.deletes = 1;
+    options.finds = 2;
+    options.seed = 1;
+    options.vectorLimit = 100000;
+
+    for (int i = 1; i + 1 < argc; i += 2){
+        string name = argv[i];
+        const char* value = argv[i + 1];
+
+        if (name == "--size")
+            options.size = atof(value);
+        else if (name == "--operations")
+            options.operations = atof(value);
+        else if (name == "--workload")
+            options.workload = value;
+        else if (name == "--mix"){
+            if (sscanf(value, "%d:%d:%d", &options.inserts, &options.deletes, &options.finds) != 3)
+                return false;
+        } else if (name == "--seed")
+            options.seed = atoi(value);
+        else if (name == "--vector-limit")
+            options.vectorLimit = atof(value);
+        else
+            return false;
+    }
+    if (options.operations < 0)
+        options.operations = options.size;
+
+    bool known = options.workload == "all" || options.workload == "sequential" || options.workload == "uniform" ||
+                 options.workload == "zipf" || options.workload == "window";
+    return argc % 2 == 1 && known && options.size >= 1 && options.size <= 1000000000 && 
+           options.inserts >= 0 && options.deletes >= 0 && options.finds >= 0 && 
+           options.inserts + options.deletes + options.finds > 0;
+}
+
+int main(int argc, char const *argv[])
+{
+    Options options;
+    if (!ParseOptions(argc, argv, options)){
+        PrintUsage();
+        return 1;
+    }
+
+    vector<string> workloads = {"sequential", "uniform", "zipf", "window"};
+    if (options.workload != "all")
+        workloads = {options.workload};
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int i = 0; i < 1000; i++)
+        chrono::steady_clock::now();
+    double timer = Nanoseconds(chrono::steady_clock::now() - start) / 1000;
+
+    printf("size %lld, operations %lld, mix I:D:F %d:%d:%d, seed %u, timer overhead %.0f ns in the latencies\n\n",
+           options.size, options.operations, options.inserts, options.deletes, options.finds, options.seed, timer);
+    printf("%-11s %-23s %12s %9s %9s %9s %10s %12s %11s %11s\n", "workload", "structure", "ops/s", 
+           "p50 ns", "p99 ns", "p999 ns", "bytes/key", "rotations", "found", "final size");
+
+    for (const string& workload : workloads){
+        Run<RedBlackTreeSubject>(workload, options);
+        Run<CompactRedBlackTreeSubject>(workload, options);
+        Run<PersistentRedBlackTreeSubject>(workload, options);
+        Run<SetSubject>(workload, options);
+        if (options.size <= options.vectorLimit && options.operations <= options.vectorLimit)
+            Run<SortedVectorSubject>(workload, options);
+        else
+            printf("%-11s %-23s skipped above the vector limit\n", workload.c_str(), SortedVectorSubject::Name());
+    }
+    return 0;
+}
@@ -0,0 +1,35 @@
+#include "rb_tree_test.h"
+
+// Runs every test of the tester, the parallel cases are large enough to spawn threads
+int main()
+{
+    RedBlackTreeTester t;
+
+    t.TestSequence(1000);
+    t.TestKthMinSequence(1000);
+    t.TestRandomSequence(1000, 1);
+    t.TestRandomPermutation(1000, 2);
+    t.TestClear(1000, 3);
+    t.TestHintInsert(1000, 4);
+    t.TestValues(1000, 5);
+    t.TestBuildFromSorted(1000, 1);
+    t.TestBuildFromSorted(200000, 4);
+
+    for (int length : {1, 2, 3, 10, 100, 1000}){
+        t.TestSplitJoin(length, length);
+        t.TestSetOperations(length, length, 1);
+        t.TestRangeQueries(length, length);
+        t.TestBatches(length, length);
+        t.TestCompactTree(length, length);
+        t.TestFrozenTree(length, length);
+        t.TestPersistentTree(length, length, 2);
+        t.TestApplyBatch(length, length, 1);
+    }
+    t.TestSetOperations(200000, 6, 4);
+    t.TestFrozenTree(50000, 7);
+    t.TestPersistentTree(20000, 8, 3);
+    t.TestApplyBatch(200000, 9, 4);
+
+    cout << "All tests passed" << endl;
+    return 0;
+}
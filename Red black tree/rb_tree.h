@@ -2,111 +2,382 @@
 #define __RB_TREE_H__
 
 #include "node.h"
+#include "node_pool.h"
+#include "frozen_rb_tree.h"
 #include <iostream>
 #include <vector>
 #include <string>
 #include <limits>
 #include <ctime>
 #include <stdlib.h>
+#include <utility>
+#include <functional>
+#include <type_traits>
+#include <thread>
+#include <iterator>
+#include <cstddef>
+#include <algorithm>
+#ifdef RB_TREE_STATS
+#include <atomic>
+#endif
 
-class RedBlackTree
+/**
+ * Red black tree of unique keys with values stored in the nodes. 
+ * RedBlackTree<int> is a set of ints, the default empty value takes no space.
+ */
+class RedBlackTreeTester;
+
+template <class Key, class Value = NoValue, class Compare = std::less<Key>>
+class RedBlackTree : private Compare
 {
+    friend class RedBlackTreeTester;
 public: 
-    RedBlackTree();
+    typedef Node<Key, Value> NodeType;
+
+    // Insertion or deletion of the key applied by ApplyBatch()
+    struct BatchOperation {
+        Key key;
+        bool insert;
+    };
+
+    /**
+     * Bidirectional in-order iterator over the nodes, 
+     * a step takes amortized O(1), end() is the position after the maximal node
+     */
+    class Iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef NodeType value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef NodeType* pointer;
+        typedef NodeType& reference;
+
+        Iterator() : node(nullptr), tree(nullptr) {}
+
+        NodeType& operator*() const {return *node;}
+        NodeType* operator->() const {return node;}
+
+        Iterator& operator++() {node = tree->Successor(node); return *this;}
+        Iterator operator++(int) {Iterator previous = *this; ++*this; return previous;}
+        Iterator& operator--() {node = node? tree->Predecessor(node) : tree->maxNode; return *this;}
+        Iterator operator--(int) {Iterator previous = *this; --*this; return previous;}
+
+        bool operator==(const Iterator& other) const {return node == other.node;}
+        bool operator!=(const Iterator& other) const {return node != other.node;}
+    private:
+        friend class RedBlackTree;
+
+        Iterator(NodeType* node, RedBlackTree* tree) : node(node), tree(tree) {}
+
+        NodeType* node;
+        RedBlackTree* tree;
+    };
+
+    RedBlackTree(const Compare& compare = Compare());
     ~RedBlackTree();
 
-    void Insert(int key);
+    std::pair<NodeType*, bool> Insert(const Key& key);
+
+    std::pair<NodeType*, bool> Insert(NodeType* hint, const Key& key);
+
+    template <class K, class... Args>
+    std::pair<NodeType*, bool> Emplace(K&& key, Args&&... args);
+
+    template <class K, class... Args>
+    std::pair<NodeType*, bool> EmplaceHint(NodeType* hint, K&& key, Args&&... args);
 
-    void Delete(int key);
+    void Delete(const Key& key);
 
-    bool Find(int key);
+    bool Find(const Key& key);
+
+    void FindBatch(const Key* keys, size_t count, bool* found);
+
+    Value* Get(const Key& key);
+
+    Iterator LowerBound(const Key& key);
+
+    Iterator UpperBound(const Key& key);
     
-    int KMin(int k);
+    Key KMin(int k);
+
+    void KMinBatch(const int* ranks, size_t count, Key* result);
+
+    int Rank(const Key& key);
+
+    int CountRange(const Key& low, const Key& high);
+
+    int Size();
+
+    FrozenRedBlackTree<Key, Compare> Freeze();
+
+    void Freeze(FrozenRedBlackTree<Key, Compare>& snapshot);
 
     void Print();
 
-    Node* Head() {return head;}
+    void Clear();
+
+    template <class KeyIterator>
+    void BuildFromSorted(KeyIterator begin, KeyIterator end, int threads = 1);
+
+    void Join(RedBlackTree& greater);
+
+    void Split(const Key& key, RedBlackTree& greater);
+
+    void SplitAtRank(int k, RedBlackTree& greater);
+
+    void Union(RedBlackTree& other, int threads = 1);
+
+    void Intersection(RedBlackTree& other, int threads = 1);
+
+    void Difference(RedBlackTree& other, int threads = 1);
+
+    void ApplyBatch(const BatchOperation* operations, size_t count, int threads = 1);
+
+    NodeType* Head() {return head;}
+
+#ifdef RB_TREE_STATS
+    // Rotations since the construction, counted by the builds measuring the tree
+    size_t Rotations() const {return rotations;}
+#endif
+
+    Iterator begin() {return Iterator(minNode, this);}
+    Iterator end() {return Iterator(nullptr, this);}
 
 private:
-    void Rotate(Node* node);
+    bool Less(const Key& a, const Key& b) const {return static_cast<const Compare&>(*this)(a, b);}
+
+    void Rotate(NodeType* node);
+
+    void PrintNode(NodeType* node);
+
+    NodeType* FindNode(const Key& key);
+
+    int CountLess(const Key& key, bool orEqual);
+
+    // Descents of a batch advanced together, the tree is never higher than 2 log2(n + 1)
+    enum { batchLanes = 16, maxHeight = 64 };
+
+    // Descent of a lane, the nodes where it turned left bound the next sorted query
+    struct BatchLane {
+        size_t query;
+        size_t last;
+        NodeType* node;
+        int base;
+        int turns;
+        NodeType* leftTurns[maxHeight];
+        int leftTurnBases[maxHeight];
+    };
+
+    template <class Start, class Step>
+    void RunBatch(size_t count, Start start, Step step);
+
+    void FixUpInsert(NodeType* node);
+
+    void FixDoubleRed(NodeType* node);
+
+    void FixUpDelete(NodeType* node);
+
+    NodeType* Min(NodeType* node);
+
+    NodeType* Max(NodeType* node);
+
+    NodeType* Successor(NodeType* node);
+
+    NodeType* Predecessor(NodeType* node);
+
+    template <class K, class... Args>
+    NodeType* Attach(NodeType* parent, bool left, bool countAncestors, K&& key, Args&&... args);
+
+    void DestroyNodes();
+
+    template <class KeyIterator>
+    NodeType* BuildSubtree(NodeType* nodes, KeyIterator keys, size_t first, size_t last, 
+                           NodeType* parent, int depth, int redDepth, int threads);
+
+    // Smallest subtree which is built or merged by another thread
+    enum { parallelSize = 1 << 16 };
+
+    // Smaller batches are applied one operation at a time
+    enum { minBatchSize = 64 };
+
+    // Detached subtree, its root may be red
+    struct Subtree {
+        NodeType* root;
+        int blackHeight;
+        int size;
+    };
+
+    enum SetOperation { UNION, INTERSECTION, DIFFERENCE };
+
+    Subtree TakeSubtree();
+
+    void SetSubtree(Subtree tree);
+
+    void Expose(Subtree tree, Subtree& left, Subtree& right);
+
+    Subtree JoinSubtrees(Subtree left, NodeType* node, Subtree right);
+
+    Subtree Concatenate(Subtree left, Subtree right);
+
+    NodeType* SplitSubtree(Subtree tree, const Key& key, Subtree& left, Subtree& right);
 
-    void PrintNode(Node* node);
+    void SplitSubtreeAtRank(Subtree tree, int k, Subtree& left, Subtree& right);
 
-    Node* FindNode(int key);
+    NodeType* SplitLast(Subtree tree, Subtree& rest);
 
-    void FixUpInsert(Node* node);
+    Subtree Combine(Subtree a, Subtree b, SetOperation operation, int threads, std::vector<NodeType*>& garbage);
 
-    void FixUpDelete(Node* node);
+    Subtree BuildBatchSubtree(const std::vector<Key>& keys, int threads);
 
-    Node* Min(Node* node);
+    NodeType* LinkSubtree(NodeType* const* nodes, size_t first, size_t last, NodeType* parent, int depth, int redDepth, int threads);
 
-    void Replace(Node* node, Node* dest);
+    void ReleaseSubtrees(const std::vector<NodeType*>& roots);
 
-    void FixLeftNodesQuantity(Node* node);
+    void Replace(NodeType* node, NodeType* dest);
 
-    Node* head;
+    void SwapWithSuccessor(NodeType* node, NodeType* successor);
+
+    void FixLeftNodesQuantity(NodeType* node);
+
+    NodeType* head;
+
+    // Nodes with the minimal and the maximal key, they make sorted insertions O(1)
+    NodeType* minNode;
+    NodeType* maxNode;
+
+    NodePool<NodeType> pool;
+
+#ifdef RB_TREE_STATS
+    // Parallel set operations rotate in several threads
+    std::atomic<size_t> rotations;
+#endif
 };
 
 
-RedBlackTree::RedBlackTree()
+template <class Key, class Value, class Compare>
+RedBlackTree<Key, Value, Compare>::RedBlackTree(const Compare& compare) : Compare(compare)
 {
-    head = nullptr;
+    head = minNode = maxNode = nullptr;
+#ifdef RB_TREE_STATS
+    rotations = 0;
+#endif
 }
 
-RedBlackTree::~RedBlackTree()
+template <class Key, class Value, class Compare>
+RedBlackTree<Key, Value, Compare>::~RedBlackTree()
 {
-    Node* node = head;
-
-    while (node) {
-        Node* next;
-        if (node->right) {
-            next = node->right;
-            node->right = nullptr;
-        } else if (node->left) {
-            next = node->left;
-            node->left = nullptr;
-        } else {
-            next = node->parent;
-            delete node;
-        }
-        node = next;
-    }
+    Clear();
 }
 
 /**
- * Create new node with the key and insert it to the tree.
+ * Create new node with the key and insert it to the tree in one descent.
  * if there is already a node with the same key, then ignores the key.  
  * 
- * @param  {Node*} head : Head of the tree
- * @param  {int} key    : Desired key number  
+ * @param  {Key} key                  : Desired key
+ * @return {std::pair<Node*, bool>}   : Node with the key, false if the key was already there
+ */
+template <class Key, class Value, class Compare>
+std::pair<Node<Key, Value>*, bool> RedBlackTree<Key, Value, Compare>::Insert(const Key& key)
+{
+    return Emplace(key);
+}
+
+/**
+ * Insert the key next to the hint, e.g. the node of the previously inserted key.
+ * 
+ * @param  {Node*} hint               : Node near the key, can be null
+ * @param  {Key} key                  : Desired key
+ * @return {std::pair<Node*, bool>}   : Node with the key, false if the key was already there
+ */
+template <class Key, class Value, class Compare>
+std::pair<Node<Key, Value>*, bool> RedBlackTree<Key, Value, Compare>::Insert(NodeType* hint, const Key& key)
+{
+    return EmplaceHint(hint, key);
+}
+
+/**
+ * Insert the key with the value constructed in the node from the arguments.
+ * The node is created only if the key is not in the tree yet.
+ * 
+ * @param  {K} key                    : Desired key
+ * @param  {Args} args                : Arguments of the value constructor
+ * @return {std::pair<Node*, bool>}   : Node with the key, false if the key was already there
  */
-void RedBlackTree::Insert(int key)
+template <class Key, class Value, class Compare>
+template <class K, class... Args>
+std::pair<Node<Key, Value>*, bool> RedBlackTree<Key, Value, Compare>::Emplace(K&& key, Args&&... args)
 {
     if (!head){
-        head = new Node(key, BLACK);
-        return;
+        head = minNode = maxNode = pool.Allocate(BLACK, nullptr, std::forward<K>(key), std::forward<Args>(args)...);
+        return std::make_pair(head, true);
     }
 
-    if (FindNode(key))
-        return;
-
-    Node* node = head;
-    while (node->key != key)
+    // Left counts are increased on the way down and returned back for a duplicate
+    NodeType* node = head;
+    while (true)
     {
-        if (key < node->key) {
-            if (!node->left)
-                node->left = new Node(key, RED, node);
-
+        if (Less(key, node->key)) {
             node->quantityLeftNodes++;
+            if (!node->left)
+                return std::make_pair(Attach(node, true, false, std::forward<K>(key), std::forward<Args>(args)...), true);
             node = node->left;
-        } else {
+        } else if (Less(node->key, key)) {
             if (!node->right)
-                node->right = new Node(key, RED, node);
+                return std::make_pair(Attach(node, false, false, std::forward<K>(key), std::forward<Args>(args)...), true);
             node = node->right;
+        } else {
+            FixLeftNodesQuantity(node);
+            return std::make_pair(node, false);
         }
     }
+}
+
+/**
+ * Emplace the key next to the hint.
+ * Ascending and descending keys are attached to the maximal and the minimal node 
+ * without any descent, otherwise the hint is used if the key lies between 
+ * the hint and its neighbour and the key is inserted from the head if not.
+ * 
+ * @param  {Node*} hint               : Node near the key, can be null
+ * @param  {K} key                    : Desired key
+ * @param  {Args} args                : Arguments of the value constructor
+ * @return {std::pair<Node*, bool>}   : Node with the key, false if the key was already there
+ */
+template <class Key, class Value, class Compare>
+template <class K, class... Args>
+std::pair<Node<Key, Value>*, bool> RedBlackTree<Key, Value, Compare>::EmplaceHint(NodeType* hint, K&& key, Args&&... args)
+{
+    if (!hint || !head)
+        return Emplace(std::forward<K>(key), std::forward<Args>(args)...);
+
+    if (Less(hint->key, key)){
+        NodeType* next = hint == maxNode? nullptr : Successor(hint);
+        if (next && !Less(key, next->key) && !Less(next->key, key))
+            return std::make_pair(next, false);
+
+        // Either the hint has no right child or the successor has no left child
+        if (!next || Less(key, next->key)){
+            NodeType* node = hint->right? 
+                Attach(next, true, true, std::forward<K>(key), std::forward<Args>(args)...) : 
+                Attach(hint, false, true, std::forward<K>(key), std::forward<Args>(args)...);
+            return std::make_pair(node, true);
+        }
+    } else if (Less(key, hint->key)){
+        NodeType* previous = hint == minNode? nullptr : Predecessor(hint);
+        if (previous && !Less(previous->key, key) && !Less(key, previous->key))
+            return std::make_pair(previous, false);
 
-   FixUpInsert(node);
+        if (!previous || Less(previous->key, key)){
+            NodeType* node = hint->left? 
+                Attach(previous, false, true, std::forward<K>(key), std::forward<Args>(args)...) : 
+                Attach(hint, true, true, std::forward<K>(key), std::forward<Args>(args)...);
+            return std::make_pair(node, true);
+        }
+    } else
+        return std::make_pair(hint, false);
+
+    return Emplace(std::forward<K>(key), std::forward<Args>(args)...);
 }
 
 /**
@@ -115,21 +386,20 @@ void RedBlackTree::Insert(int key)
  * @param  {Node*} head : Head of the tree
  * @param  {int} key    : Desired key number 
  */
-void RedBlackTree::Delete(int key) 
+template <class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::Delete(const Key& key) 
 {
-    Node* node = FindNode(key);
+    NodeType* node = FindNode(key);
 
     if (node == nullptr)
         return;
 
-    // Find successor and update it with the node
-    if (node->left && node->right){
-        Node* swap = Min(node->right);
-        node->key = swap->key;
-        node = swap;
-    }
+    // The successor takes the place of the node, so nodes of other keys stay valid
+    if (node->left && node->right)
+        SwapWithSuccessor(node, Min(node->right));
+    bool extreme = node == minNode || node == maxNode;
 
-    Node* replaceNode;
+    NodeType* replaceNode;
 
     // Replace child with deleting node
     if (node->left){
@@ -163,7 +433,12 @@ void RedBlackTree::Delete(int key)
     if (node == head && !node->left && !node->right)
         head = nullptr;
 
-	delete node;
+    pool.Release(node);
+
+    if (extreme){
+        minNode = head? Min(head) : nullptr;
+        maxNode = head? Max(head) : nullptr;
+    }
 }
 
 /**
@@ -173,19 +448,125 @@ void RedBlackTree::Delete(int key)
  * @param  {int} key    : Desired key number 
  * @return {bool}       : Return false if not found
  */
-bool RedBlackTree::Find(int key) 
+template <class Key, class Value, class Compare>
+bool RedBlackTree<Key, Value, Compare>::Find(const Key& key) 
 {
     return FindNode(key) == nullptr? false : true;
 }
 
+/**
+ * Find many keys with the descents interleaved, every descent prefetches 
+ * its next node while the others are advanced. The batch is split between 
+ * the descents, if it is sorted, each descent continues from the deepest node 
+ * of its previous path which bounds the next key.
+ * 
+ * @param  {Key*} keys    : Searched keys
+ * @param  {size_t} count : Number of the keys
+ * @param  {bool*} found  : Output, found[i] is Find(keys[i])
+ */
+template <class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::FindBatch(const Key* keys, size_t count, bool* found) 
+{
+    bool sorted = std::is_sorted(keys, keys + count, [this](const Key& a, const Key& b){return Less(a, b);});
+
+    auto start = [&](BatchLane& lane){
+        const Key& key = keys[lane.query];
+        if (!sorted)
+            lane.turns = 0;
+        while (lane.turns > 0 && !Less(key, lane.leftTurns[lane.turns - 1]->key))
+            lane.turns--;
+        lane.node = lane.turns > 0? lane.leftTurns[lane.turns - 1]->left : head;
+    };
+
+    auto step = [&](BatchLane& lane){
+        NodeType* node = lane.node;
+        const Key& key = keys[lane.query];
+
+        if (!node || !(Less(key, node->key) | Less(node->key, key))){
+            found[lane.query] = node != nullptr;
+            return true;
+        }
+        if (Less(key, node->key)){
+            lane.leftTurns[lane.turns++] = node;
+            lane.node = node->left;
+        } else
+            lane.node = node->right;
+        return false;
+    };
+
+    RunBatch(count, start, step);
+}
+
+/**
+ * Value of the key
+ * 
+ * @param  {Key} key    : Desired key
+ * @return {Value*}     : Value stored with the key, null if not found
+ */
+template <class Key, class Value, class Compare>
+Value* RedBlackTree<Key, Value, Compare>::Get(const Key& key) 
+{
+    NodeType* node = FindNode(key);
+    return node? &node->MappedValue() : nullptr;
+}
+
+/**
+ * First node with the key not less than the given one
+ * 
+ * @param  {Key} key        : Searched key
+ * @return {Iterator}       : Position of the node, end() if all keys are less
+ */
+template <class Key, class Value, class Compare>
+typename RedBlackTree<Key, Value, Compare>::Iterator RedBlackTree<Key, Value, Compare>::LowerBound(const Key& key) 
+{
+    NodeType* bound = nullptr;
+
+    for (NodeType* node = head; node; )
+    {
+        if (Less(node->key, key))
+            node = node->right;
+        else {
+            bound = node;
+            node = node->left;
+        }
+    }
+    return Iterator(bound, this);
+}
+
+/**
+ * First node with the key greater than the given one
+ * 
+ * @param  {Key} key        : Searched key
+ * @return {Iterator}       : Position of the node, end() if no key is greater
+ */
+template <class Key, class Value, class Compare>
+typename RedBlackTree<Key, Value, Compare>::Iterator RedBlackTree<Key, Value, Compare>::UpperBound(const Key& key) 
+{
+    NodeType* bound = nullptr;
+
+    for (NodeType* node = head; node; )
+    {
+        if (Less(key, node->key)){
+            bound = node;
+            node = node->left;
+        } else
+            node = node->right;
+    }
+    return Iterator(bound, this);
+}
+
 
 /**
  * Rotate the node right or left, depends on the parent.
  * 
  * @param  {Node*} node : Given node for rotation
  */
-void RedBlackTree::Rotate(Node* node) 
+template <class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::Rotate(NodeType* node) 
 {
+#ifdef RB_TREE_STATS
+    rotations.fetch_add(1, std::memory_order_relaxed);
+#endif
     if (node->parent){
         if (node->parent->right == node){ // left rotation
             if (node->left)
@@ -208,10 +589,10 @@ void RedBlackTree::Rotate(Node* node)
                 node->parent->parent->right = node;
             else
                 node->parent->parent->left = node;
-        else
+        else if (node->parent == head)
             head = node;
         
-        Node* originalParent = node->parent;
+        NodeType* originalParent = node->parent;
         node->parent = node->parent->parent;
         originalParent->parent = node;
     }
@@ -222,7 +603,8 @@ void RedBlackTree::Rotate(Node* node)
  * 
  * @param  {Node*} node : Target node
  */
-void RedBlackTree::PrintNode(Node* node) 
+template <class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::PrintNode(NodeType* node) 
 {
     if (node == head)
         std::cout << "=================" << std::endl;
@@ -234,17 +616,17 @@ void RedBlackTree::PrintNode(Node* node)
 
     if (node->left){
         Color = node->left->color == BLACK? 'B': 'R'; 
-        std::cout << Color + std::to_string(node->left->key) + " <- ";
+        std::cout << Color << node->left->key << " <- ";
     }
     else
         std::cout << "      ";
 
     Color = node->color == BLACK? 'B': 'R'; 
-        std::cout << Color + std::to_string(node->key);
+        std::cout << Color << node->key;
 
     if (node->right){
         Color = node->right->color == BLACK? 'B': 'R'; 
-        std::cout << " -> " + Color + std::to_string(node->right->key);
+        std::cout << " -> " << Color << node->right->key;
     }
 
     std::cout << std::endl;
@@ -255,20 +637,17 @@ void RedBlackTree::PrintNode(Node* node)
 /**
  * Find a node for the given key 
  * 
- * @param  {int} key : Key
+ * @param  {Key} key : Key
  * @return {Node*}   : Node with the same key
  */
-Node* RedBlackTree::FindNode(int key) 
+template <class Key, class Value, class Compare>
+Node<Key, Value>* RedBlackTree<Key, Value, Compare>::FindNode(const Key& key) 
 {
-    Node * node = head;
-    while (node && (node->key != key))
-    {
-        if (key < node->key) {
-            node = node->left;
-        } else {
-            node = node->right;
-        }
-    }
+    // Both comparisons are evaluated without a short circuit, for simple keys 
+    // they become one comparison and the child is selected without a branch
+    NodeType* node = head;
+    while (node && (Less(key, node->key) | Less(node->key, key)))
+        node = Less(key, node->key)? node->left : node->right;
 
     return node;
 }
@@ -278,11 +657,25 @@ Node* RedBlackTree::FindNode(int key)
  * 
  * @param  {Node*} node : Node to fix up
  */
-void RedBlackTree::FixUpInsert(Node* node) 
+template <class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::FixUpInsert(NodeType* node) 
 {
     if (!node)
         return;
 
+    FixDoubleRed(node);
+    head->color = BLACK;
+}
+
+/**
+ * Move the red node with the red parent up until the parent is black, 
+ * the root of the subtree may become red
+ * 
+ * @param  {Node*} node : Red node
+ */
+template <class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::FixDoubleRed(NodeType* node) 
+{
     while (node->parent && node->parent->color == RED)
     {   // Red uncle case
         if (node->Uncle() && node->Uncle()->color == RED){
@@ -297,7 +690,7 @@ void RedBlackTree::FixUpInsert(Node* node)
             // Red nodes in triangle case
             if ((node->parent == node->parent->parent->left && node == node->parent->right) || 
                 (node->parent == node->parent->parent->right && node == node->parent->left)){
-                Node * originalParent = node->parent;
+                NodeType* originalParent = node->parent;
                 Rotate(node);
                 node = originalParent;
             }
@@ -307,16 +700,16 @@ void RedBlackTree::FixUpInsert(Node* node)
             Rotate(node->parent);
         }
     }
-    head->color = BLACK;
 }
 /**
  * Fix up the tree after deletion (down up) 
  * 
  * @param  {Node*} node : Node to fix up
  */
-void RedBlackTree::FixUpDelete(Node* node) 
+template <class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::FixUpDelete(NodeType* node) 
 {
-    Node* sibling = nullptr;
+    NodeType* sibling = nullptr;
     // Case 1
     if (node->parent && node->color == BLACK)
     {
@@ -386,9 +779,10 @@ void RedBlackTree::FixUpDelete(Node* node)
  * @param  {Node*} node : Node where min should be found
  * @return {Node*}      : Node with a min key
  */
-Node* RedBlackTree::Min(Node* node) 
+template <class Key, class Value, class Compare>
+Node<Key, Value>* RedBlackTree<Key, Value, Compare>::Min(NodeType* node) 
 {
-    Node * targetNode = node;
+    NodeType* targetNode = node;
 
     while (targetNode->left != nullptr)
     {
@@ -398,13 +792,103 @@ Node* RedBlackTree::Min(Node* node)
     return targetNode;
 }
 
+/**
+ * Find a node with a maximal key in the given subtree
+ * 
+ * @param  {Node*} node : Node where max should be found
+ * @return {Node*}      : Node with a max key
+ */
+template <class Key, class Value, class Compare>
+Node<Key, Value>* RedBlackTree<Key, Value, Compare>::Max(NodeType* node) 
+{
+    while (node->right)
+        node = node->right;
+
+    return node;
+}
+
+/**
+ * Node with the next greater key
+ * 
+ * @param  {Node*} node : Node of the tree
+ * @return {Node*}      : Next node, null for the maximal node
+ */
+template <class Key, class Value, class Compare>
+Node<Key, Value>* RedBlackTree<Key, Value, Compare>::Successor(NodeType* node) 
+{
+    if (node->right)
+        return Min(node->right);
+
+    while (node->parent && node == node->parent->right)
+        node = node->parent;
+
+    return node->parent;
+}
+
+/**
+ * Node with the next smaller key
+ * 
+ * @param  {Node*} node : Node of the tree
+ * @return {Node*}      : Previous node, null for the minimal node
+ */
+template <class Key, class Value, class Compare>
+Node<Key, Value>* RedBlackTree<Key, Value, Compare>::Predecessor(NodeType* node) 
+{
+    if (node->left)
+        return Max(node->left);
+
+    while (node->parent && node == node->parent->left)
+        node = node->parent;
+
+    return node->parent;
+}
+
+/**
+ * Create a red leaf under the parent and fix up the tree
+ * 
+ * @param  {Node*} parent         : Parent without the child on the given side
+ * @param  {bool} left            : True for the left child
+ * @param  {bool} countAncestors  : Increase left counts of the ancestors, 
+ *                                  false if they were increased on the way down
+ * @param  {K} key                : Key of the new node
+ * @param  {Args} args            : Arguments of the value constructor
+ * @return {Node*}                : New node
+ */
+template <class Key, class Value, class Compare>
+template <class K, class... Args>
+Node<Key, Value>* RedBlackTree<Key, Value, Compare>::Attach(NodeType* parent, bool left, bool countAncestors, 
+                                                             K&& key, Args&&... args) 
+{
+    NodeType* node = pool.Allocate(RED, parent, std::forward<K>(key), std::forward<Args>(args)...);
+
+    if (left){
+        parent->left = node;
+        if (parent == minNode)
+            minNode = node;
+    } else {
+        parent->right = node;
+        if (parent == maxNode)
+            maxNode = node;
+    }
+
+    // The maximal node is in no left subtree
+    if (countAncestors && node != maxNode)
+        for (NodeType* child = node; child->parent; child = child->parent)
+            if (child == child->parent->left)
+                child->parent->quantityLeftNodes++;
+
+    FixUpInsert(node);
+    return node;
+}
+
 /**
  * Replace node with the destination node
  * 
  * @param  {Node*} node : Original node
  * @param  {Node*} dest : Destination node
  */
-void RedBlackTree::Replace(Node* node, Node* dest) 
+template <class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::Replace(NodeType* node, NodeType* dest) 
 {
     if (!node->parent)
         head = dest;
@@ -417,7 +901,44 @@ void RedBlackTree::Replace(Node* node, Node* dest)
         dest->parent = node->parent;
 }
 
-void RedBlackTree::FixLeftNodesQuantity(Node* node) 
+/**
+ * Exchange the positions of the node and its successor in the tree,
+ * links, colors and left counts are swapped and the keys stay in their nodes
+ * 
+ * @param  {Node*} node      : Node with two children
+ * @param  {Node*} successor : Minimal node of its right subtree
+ */
+template <class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::SwapWithSuccessor(NodeType* node, NodeType* successor) 
+{
+    NodeType* successorParent = successor->parent;
+    NodeType* successorRight = successor->right;
+
+    Replace(node, successor);
+    successor->left = node->left;
+    successor->left->parent = successor;
+
+    if (successorParent == node){
+        successor->right = node;
+        node->parent = successor;
+    } else {
+        successor->right = node->right;
+        successor->right->parent = successor;
+        successorParent->left = node;
+        node->parent = successorParent;
+    }
+
+    node->left = nullptr;
+    node->right = successorRight;
+    if (successorRight)
+        successorRight->parent = node;
+
+    std::swap(node->color, successor->color);
+    std::swap(node->quantityLeftNodes, successor->quantityLeftNodes);
+}
+
+template <class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::FixLeftNodesQuantity(NodeType* node) 
 {
     while (node->parent)
     {
@@ -432,13 +953,17 @@ void RedBlackTree::FixLeftNodesQuantity(Node* node)
  * 
  * @param  {Node*} head : Head of the tree
  * @param  {int} k      : Index number
- * @return {int}        : The Kth minimum number
+ * @return {Key}        : The Kth minimum number, the maximal value of the key type if k < 1 or k > Size()
  */
-int RedBlackTree::KMin(int k) 
+template <class Key, class Value, class Compare>
+Key RedBlackTree<Key, Value, Compare>::KMin(int k) 
 {
-    Node* node = head;
+    NodeType* node = head;
     int position = k;
 
+    if (!node || k < 1)
+        return std::numeric_limits<Key>::max();
+
     while (position > 0) 
     {
        if (node->left && node->quantityLeftNodes >= position){
@@ -449,7 +974,7 @@ int RedBlackTree::KMin(int k)
         else
         {
             if (!node->right)
-                return INT32_MAX;
+                return std::numeric_limits<Key>::max();
 
             position -= node->quantityLeftNodes + 1;
             node = node->right;
@@ -457,11 +982,871 @@ int RedBlackTree::KMin(int k)
     }
     return node->key;
 }
+/**
+ * Kth minimums of many ranks with the descents interleaved like in FindBatch,
+ * sorted ranks continue from the previous path of the descent
+ * 
+ * @param  {int*} ranks   : Ranks k
+ * @param  {size_t} count : Number of the ranks
+ * @param  {Key*} result  : Output, result[i] is KMin(ranks[i])
+ */
+template <class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::KMinBatch(const int* ranks, size_t count, Key* result) 
+{
+    bool sorted = std::is_sorted(ranks, ranks + count);
+
+    auto start = [&](BatchLane& lane){
+        int k = ranks[lane.query];
+        if (!sorted)
+            lane.turns = 0;
+        while (lane.turns > 0 && k >= lane.leftTurnBases[lane.turns - 1] + lane.leftTurns[lane.turns - 1]->quantityLeftNodes + 1)
+            lane.turns--;
+        if (lane.turns > 0){
+            lane.node = lane.leftTurns[lane.turns - 1]->left;
+            lane.base = lane.leftTurnBases[lane.turns - 1];
+        } else {
+            lane.node = head;
+            lane.base = 0;
+        }
+    };
+
+    // The base is the number of keys before the subtree of the node
+    auto step = [&](BatchLane& lane){
+        NodeType* node = lane.node;
+        int k = ranks[lane.query];
+
+        if (!node || k < 1){
+            result[lane.query] = std::numeric_limits<Key>::max();
+            return true;
+        }
+
+        int rank = lane.base + node->quantityLeftNodes + 1;
+        if (k == rank){
+            result[lane.query] = node->key;
+            return true;
+        }
+        if (k < rank){
+            lane.leftTurns[lane.turns] = node;
+            lane.leftTurnBases[lane.turns++] = lane.base;
+            lane.node = node->left;
+        } else {
+            lane.base = rank;
+            lane.node = node->right;
+        }
+        return false;
+    };
+
+    RunBatch(count, start, step);
+}
+
+/**
+ * Advance the descents of the batch in turns. The batch is split into 
+ * consecutive parts of the lanes, every lane answers its part query by query.
+ * 
+ * @param  {size_t} count   : Number of the queries
+ * @param  {Start} start    : start(lane) sets the first node of the descent of lane.query
+ * @param  {Step} step      : step(lane) moves the descent one level down, 
+ *                            true if lane.query is answered
+ */
+template <class Key, class Value, class Compare>
+template <class Start, class Step>
+void RedBlackTree<Key, Value, Compare>::RunBatch(size_t count, Start start, Step step) 
+{
+    BatchLane lanes[batchLanes];
+    int active[batchLanes];
+    int quantityActive = 0;
+    size_t part = (count + batchLanes - 1) / batchLanes;
+
+    for (int i = 0; i < batchLanes && i * part < count; i++){
+        BatchLane& lane = lanes[i];
+        lane.query = i * part;
+        lane.last = std::min(count, lane.query + part);
+        lane.turns = 0;
+        start(lane);
+        active[quantityActive++] = i;
+    }
+
+    while (quantityActive > 0)
+    {
+        for (int i = 0; i < quantityActive; )
+        {
+            BatchLane& lane = lanes[active[i]];
+
+            if (step(lane)){
+                if (++lane.query == lane.last){
+                    active[i] = active[--quantityActive];
+                    continue;
+                }
+                start(lane);
+            }
+            if (lane.node)
+                __builtin_prefetch(&lane.node->key);
+            i++;
+        }
+    }
+}
+
+/**
+ * Position of the key in the sorted keys, Rank(KMin(k)) == k.
+ * A missing key gets the position it would have after the insertion.
+ * 
+ * @param  {Key} key : Desired key
+ * @return {int}     : Position starting at 1
+ */
+template <class Key, class Value, class Compare>
+int RedBlackTree<Key, Value, Compare>::Rank(const Key& key) 
+{
+    return CountLess(key, false) + 1;
+}
+
+/**
+ * Number of the keys from low to high including both in one descent per bound
+ * 
+ * @param  {Key} low  : Minimal counted key
+ * @param  {Key} high : Maximal counted key
+ * @return {int}      : Number of the keys in the range
+ */
+template <class Key, class Value, class Compare>
+int RedBlackTree<Key, Value, Compare>::CountRange(const Key& low, const Key& high) 
+{
+    if (Less(high, low))
+        return 0;
+
+    return CountLess(high, true) - CountLess(low, false);
+}
+
+/**
+ * Number of the keys, the left counts of the right spine are summed
+ * 
+ * @return {int}      : Number of the keys
+ */
+template <class Key, class Value, class Compare>
+int RedBlackTree<Key, Value, Compare>::Size() 
+{
+    int size = 0;
+
+    for (NodeType* node = head; node; node = node->right)
+        size += node->quantityLeftNodes + 1;
+    return size;
+}
+
+/**
+ * Read-only snapshot of the keys for the read phases
+ * 
+ * @return {FrozenRedBlackTree}  : Snapshot in the Eytzinger layout
+ */
+template <class Key, class Value, class Compare>
+FrozenRedBlackTree<Key, Compare> RedBlackTree<Key, Value, Compare>::Freeze() 
+{
+    FrozenRedBlackTree<Key, Compare> snapshot(static_cast<const Compare&>(*this));
+
+    Freeze(snapshot);
+    return snapshot;
+}
+
+/**
+ * Rebuild the snapshot after updates in one in-order pass, 
+ * its arrays are reused
+ * 
+ * @param  {FrozenRedBlackTree} snapshot : Snapshot of this tree
+ */
+template <class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::Freeze(FrozenRedBlackTree<Key, Compare>& snapshot) 
+{
+    snapshot.Build(begin(), Size());
+}
+
+/**
+ * Number of the keys less than the key, the left counts of the nodes
+ * passed to the right are summed on the way down
+ * 
+ * @param  {Key} key      : Bound
+ * @param  {bool} orEqual : Count the key itself too
+ * @return {int}          : Number of the keys
+ */
+template <class Key, class Value, class Compare>
+int RedBlackTree<Key, Value, Compare>::CountLess(const Key& key, bool orEqual) 
+{
+    int count = 0;
+
+    for (NodeType* node = head; node; )
+    {
+        if (orEqual? !Less(key, node->key) : Less(node->key, key)){
+            count += node->quantityLeftNodes + 1;
+            node = node->right;
+        } else
+            node = node->left;
+    }
+    return count;
+}
+
+/**
+ * Delete all nodes, the blocks of the pool are released without visiting the nodes
+ * unless the keys or the values have destructors
+ * 
+ */
+template <class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::Clear() 
+{
+    if (!std::is_trivially_destructible<NodeType>::value)
+        DestroyNodes();
+
+    pool.Clear();
+    head = minNode = maxNode = nullptr;
+}
+
+/**
+ * Replace the tree by the perfectly balanced tree of the sorted keys in linear time.
+ * Nodes are allocated in one block in the order of the keys, every subtree 
+ * covers consecutive nodes, so the subtrees can be built by separate threads.
+ * Values are default constructed.
+ * 
+ * @param  {KeyIterator} begin : Random access iterator of the strictly increasing keys
+ * @param  {KeyIterator} end   : End of the keys
+ * @param  {int} threads       : Number of threads building the subtrees
+ */
+template <class Key, class Value, class Compare>
+template <class KeyIterator>
+void RedBlackTree<Key, Value, Compare>::BuildFromSorted(KeyIterator begin, KeyIterator end, int threads) 
+{
+    Clear();
+
+    size_t count = end - begin;
+    if (count == 0)
+        return;
+
+    // Only the deepest level may be incomplete, its nodes are red leaves
+    int redDepth = 0;
+    while ((size_t(2) << redDepth) <= count)
+        redDepth++;
+
+    NodeType* nodes = pool.AllocateBlock(count);
+    head = BuildSubtree(nodes, begin, 0, count, nullptr, 0, redDepth, threads);
+    minNode = nodes;
+    maxNode = nodes + count - 1;
+}
+
+/**
+ * Build the subtree of the keys from first to last - 1, the middle key is the root
+ * 
+ * @param  {Node*} nodes       : Storage of the nodes, the node of the key i is nodes[i]
+ * @param  {KeyIterator} keys  : Sorted keys
+ * @param  {size_t} first      : First key of the subtree
+ * @param  {size_t} last       : Key after the subtree
+ * @param  {Node*} parent      : Parent of the subtree
+ * @param  {int} depth         : Depth of the root of the subtree
+ * @param  {int} redDepth      : Depth of the deepest level
+ * @param  {int} threads       : Number of threads for the subtree
+ * @return {Node*}             : Root of the subtree, null if it is empty
+ */
+template <class Key, class Value, class Compare>
+template <class KeyIterator>
+Node<Key, Value>* RedBlackTree<Key, Value, Compare>::BuildSubtree(NodeType* nodes, KeyIterator keys, size_t first, size_t last, 
+                                                                   NodeType* parent, int depth, int redDepth, int threads) 
+{
+    if (first == last)
+        return nullptr;
+
+    size_t middle = first + (last - first) / 2;
+    ColorType color = depth == redDepth && depth > 0? RED : BLACK;
+    NodeType* node = new (nodes + middle) NodeType(color, parent, keys[middle]);
+    node->quantityLeftNodes = middle - first;
+
+    if (threads > 1 && last - first >= parallelSize){
+        std::thread left([=]{ 
+            node->left = BuildSubtree(nodes, keys, first, middle, node, depth + 1, redDepth, threads / 2); 
+        });
+        node->right = BuildSubtree(nodes, keys, middle + 1, last, node, depth + 1, redDepth, threads - threads / 2);
+        left.join();
+    } else {
+        node->left = BuildSubtree(nodes, keys, first, middle, node, depth + 1, redDepth, 1);
+        node->right = BuildSubtree(nodes, keys, middle + 1, last, node, depth + 1, redDepth, 1);
+    }
+
+    return node;
+}
+
+/**
+ * Append the greater tree to this one, the greater tree becomes empty
+ * 
+ * @param  {RedBlackTree} greater : Tree with the keys greater than all keys of this tree
+ */
+template <class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::Join(RedBlackTree& greater) 
+{
+    pool.Share(greater.pool);
+    Subtree left = TakeSubtree();
+    SetSubtree(Concatenate(left, greater.TakeSubtree()));
+}
+
+/**
+ * Move the keys which are not less than the key to the greater tree,
+ * the previous content of the greater tree is deleted
+ * 
+ * @param  {Key} key              : Smallest key of the greater tree
+ * @param  {RedBlackTree} greater : Tree receiving the keys
+ */
+template <class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::Split(const Key& key, RedBlackTree& greater) 
+{
+    greater.Clear();
+    greater.pool.Share(pool);
+
+    Subtree left, right;
+    NodeType* node = SplitSubtree(TakeSubtree(), key, left, right);
+    if (node)
+        right = JoinSubtrees(Subtree{nullptr, 0, 0}, node, right);
+
+    SetSubtree(left);
+    greater.SetSubtree(right);
+}
+
+/**
+ * Keep the k minimal keys and move the others to the greater tree,
+ * the previous content of the greater tree is deleted
+ * 
+ * @param  {int} k                : Number of kept keys
+ * @param  {RedBlackTree} greater : Tree receiving the keys
+ */
+template <class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::SplitAtRank(int k, RedBlackTree& greater) 
+{
+    greater.Clear();
+    greater.pool.Share(pool);
+
+    Subtree left, right;
+    SplitSubtreeAtRank(TakeSubtree(), k, left, right);
+
+    SetSubtree(left);
+    greater.SetSubtree(right);
+}
+
+/**
+ * Add the keys of the other tree, the nodes of this tree are kept for the common keys.
+ * The other tree becomes empty, its nodes are moved without copying.
+ * 
+ * @param  {RedBlackTree} other : Added tree
+ * @param  {int} threads        : Number of threads merging the subtrees
+ */
+template <class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::Union(RedBlackTree& other, int threads) 
+{
+    std::vector<NodeType*> garbage;
+
+    pool.Share(other.pool);
+    Subtree tree = TakeSubtree();
+    SetSubtree(Combine(tree, other.TakeSubtree(), UNION, threads, garbage));
+    ReleaseSubtrees(garbage);
+}
+
+/**
+ * Keep only the keys which are in the other tree too, the other tree becomes empty
+ * 
+ * @param  {RedBlackTree} other : Intersected tree
+ * @param  {int} threads        : Number of threads merging the subtrees
+ */
+template <class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::Intersection(RedBlackTree& other, int threads) 
+{
+    std::vector<NodeType*> garbage;
+
+    pool.Share(other.pool);
+    Subtree tree = TakeSubtree();
+    SetSubtree(Combine(tree, other.TakeSubtree(), INTERSECTION, threads, garbage));
+    ReleaseSubtrees(garbage);
+}
+
+/**
+ * Delete the keys of the other tree, the other tree becomes empty
+ * 
+ * @param  {RedBlackTree} other : Subtracted tree
+ * @param  {int} threads        : Number of threads merging the subtrees
+ */
+template <class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::Difference(RedBlackTree& other, int threads) 
+{
+    std::vector<NodeType*> garbage;
+
+    pool.Share(other.pool);
+    Subtree tree = TakeSubtree();
+    SetSubtree(Combine(tree, other.TakeSubtree(), DIFFERENCE, threads, garbage));
+    ReleaseSubtrees(garbage);
+}
+
+/**
+ * Apply the insertions and deletions like one by one. The sorted keys of the batch 
+ * are built into subtrees which are subtracted and added by the set operations,
+ * so the paths and the sizes of the nodes are fixed once for the whole batch.
+ * Inserted keys get default constructed values.
+ * 
+ * @param  {BatchOperation*} operations : Operations in the order of applying
+ * @param  {size_t} count               : Number of the operations
+ * @param  {int} threads                : Number of threads building and merging the subtrees
+ */
+template <class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::ApplyBatch(const BatchOperation* operations, size_t count, int threads) 
+{
+    if (count < minBatchSize){
+        for (size_t i = 0; i < count; i++){
+            if (operations[i].insert)
+                Insert(operations[i].key);
+            else
+                Delete(operations[i].key);
+        }
+        return;
+    }
+
+    std::vector<BatchOperation> sorted(operations, operations + count);
+    std::vector<Key> inserted, deleted;
+
+    // The stable sort keeps the order of the operations of a key, the last one wins
+    std::stable_sort(sorted.begin(), sorted.end(), [this](const BatchOperation& a, const BatchOperation& b){ 
+        return Less(a.key, b.key); 
+    });
+    for (size_t i = 0; i < count; i++){
+        if (i + 1 < count && !Less(sorted[i].key, sorted[i + 1].key))
+            continue;
+        if (sorted[i].insert)
+            inserted.push_back(sorted[i].key);
+        else
+            deleted.push_back(sorted[i].key);
+    }
+
+    // Deleted nodes are released before the inserted keys take their slots
+    std::vector<NodeType*> garbage;
+    if (!deleted.empty()){
+        Subtree tree = TakeSubtree();
+        SetSubtree(Combine(tree, BuildBatchSubtree(deleted, threads), DIFFERENCE, threads, garbage));
+        ReleaseSubtrees(garbage);
+        garbage.clear();
+    }
+    if (!inserted.empty()){
+        Subtree tree = TakeSubtree();
+        SetSubtree(Combine(tree, BuildBatchSubtree(inserted, threads), UNION, threads, garbage));
+        ReleaseSubtrees(garbage);
+    }
+}
+
+/**
+ * Detached balanced subtree of the sorted keys. Unlike BuildFromSorted() the nodes are 
+ * allocated one by one from the pool of this tree, so the slots released by the previous
+ * operations are reused and the pool does not grow with every batch.
+ * 
+ * @param  {std::vector<Key>} keys : Strictly increasing keys
+ * @param  {int} threads           : Number of threads linking the subtrees
+ * @return {Subtree}               : Subtree of the keys
+ */
+template <class Key, class Value, class Compare>
+typename RedBlackTree<Key, Value, Compare>::Subtree RedBlackTree<Key, Value, Compare>::BuildBatchSubtree(const std::vector<Key>& keys, int threads) 
+{
+    std::vector<NodeType*> nodes(keys.size());
+    for (size_t i = 0; i < keys.size(); i++)
+        nodes[i] = pool.Allocate(BLACK, nullptr, keys[i]);
+
+    int redDepth = 0;
+    while ((size_t(2) << redDepth) <= keys.size())
+        redDepth++;
+
+    Subtree tree = {LinkSubtree(nodes.data(), 0, nodes.size(), nullptr, 0, redDepth, threads), 0, int(keys.size())};
+    for (NodeType* node = tree.root; node; node = node->left)
+        tree.blackHeight += node->color == BLACK;
+    return tree;
+}
+
+/**
+ * Link the allocated nodes from first to last - 1 like BuildSubtree(), the middle node is the root
+ * 
+ * @param  {Node**} nodes      : Nodes in the order of the keys
+ * @param  {size_t} first      : First node of the subtree
+ * @param  {size_t} last       : Node after the subtree
+ * @param  {Node*} parent      : Parent of the subtree
+ * @param  {int} depth         : Depth of the root of the subtree
+ * @param  {int} redDepth      : Depth of the deepest level
+ * @param  {int} threads       : Number of threads for the subtree
+ * @return {Node*}             : Root of the subtree, null if it is empty
+ */
+template <class Key, class Value, class Compare>
+Node<Key, Value>* RedBlackTree<Key, Value, Compare>::LinkSubtree(NodeType* const* nodes, size_t first, size_t last, 
+                                                                  NodeType* parent, int depth, int redDepth, int threads) 
+{
+    if (first == last)
+        return nullptr;
+
+    size_t middle = first + (last - first) / 2;
+    NodeType* node = nodes[middle];
+    node->color = depth == redDepth && depth > 0? RED : BLACK;
+    node->parent = parent;
+    node->quantityLeftNodes = middle - first;
+
+    if (threads > 1 && last - first >= parallelSize){
+        std::thread left([=]{ 
+            node->left = LinkSubtree(nodes, first, middle, node, depth + 1, redDepth, threads / 2); 
+        });
+        node->right = LinkSubtree(nodes, middle + 1, last, node, depth + 1, redDepth, threads - threads / 2);
+        left.join();
+    } else {
+        node->left = LinkSubtree(nodes, first, middle, node, depth + 1, redDepth, 1);
+        node->right = LinkSubtree(nodes, middle + 1, last, node, depth + 1, redDepth, 1);
+    }
+
+    return node;
+}
+
+/**
+ * Detach all nodes from the tree, the tree becomes empty
+ * 
+ * @return {Subtree}  : Former tree with its black height and size
+ */
+template <class Key, class Value, class Compare>
+typename RedBlackTree<Key, Value, Compare>::Subtree RedBlackTree<Key, Value, Compare>::TakeSubtree() 
+{
+    Subtree tree = {head, 0, 0};
+
+    for (NodeType* node = head; node; node = node->left)
+        tree.blackHeight += node->color == BLACK;
+    for (NodeType* node = head; node; node = node->right)
+        tree.size += node->quantityLeftNodes + 1;
+
+    head = minNode = maxNode = nullptr;
+    return tree;
+}
+
+/**
+ * Make the subtree the content of the empty tree
+ * 
+ * @param  {Subtree} tree : New content
+ */
+template <class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::SetSubtree(Subtree tree) 
+{
+    head = tree.root;
+    if (!head)
+        return;
+
+    head->parent = nullptr;
+    head->color = BLACK;
+    minNode = Min(head);
+    maxNode = Max(head);
+}
+
+/**
+ * Detach the children of the root of the subtree
+ * 
+ * @param  {Subtree} tree  : Non-empty subtree
+ * @param  {Subtree} left  : Left subtree of the root
+ * @param  {Subtree} right : Right subtree of the root
+ */
+template <class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::Expose(Subtree tree, Subtree& left, Subtree& right) 
+{
+    NodeType* root = tree.root;
+    int childHeight = tree.blackHeight - (root->color == BLACK);
+
+    left = Subtree{root->left, childHeight, root->quantityLeftNodes};
+    right = Subtree{root->right, childHeight, tree.size - root->quantityLeftNodes - 1};
+
+    if (root->left)
+        root->left->parent = nullptr;
+    if (root->right)
+        root->right->parent = nullptr;
+    root->left = root->right = nullptr;
+}
+
+/**
+ * Join the subtrees with the node between them. The node is hung on the spine 
+ * of the higher subtree where the black heights are equal and the double red 
+ * is fixed up like after an insertion, so it takes O(difference of the heights).
+ * 
+ * @param  {Subtree} left  : Subtree with the smaller keys
+ * @param  {Node*} node    : Detached node with a key between the subtrees
+ * @param  {Subtree} right : Subtree with the greater keys
+ * @return {Subtree}       : Joined subtree
+ */
+template <class Key, class Value, class Compare>
+typename RedBlackTree<Key, Value, Compare>::Subtree RedBlackTree<Key, Value, Compare>::JoinSubtrees(Subtree left, NodeType* node, Subtree right) 
+{
+    // With black roots the red node never has a red child
+    if (left.root && left.root->color == RED){
+        left.root->color = BLACK;
+        left.blackHeight++;
+    }
+    if (right.root && right.root->color == RED){
+        right.root->color = BLACK;
+        right.blackHeight++;
+    }
+
+    NodeType* parent = nullptr;
+    Subtree joined = {nullptr, 0, left.size + right.size + 1};
+
+    node->color = RED;
+    if (left.blackHeight > right.blackHeight){
+        // The right spine of the left subtree keeps its left counts
+        NodeType* child = left.root;
+        int size = left.size;
+        for (int height = left.blackHeight; child && (child->color == RED || height > right.blackHeight); child = child->right){
+            height -= child->color == BLACK;
+            size -= child->quantityLeftNodes + 1;
+            parent = child;
+        }
+        node->left = child;
+        node->right = right.root;
+        node->quantityLeftNodes = size;
+        parent->right = node;
+        joined.root = left.root;
+        joined.blackHeight = left.blackHeight;
+    } else if (left.blackHeight < right.blackHeight){
+        // The node and the left subtree join the left subtrees of the spine
+        NodeType* child = right.root;
+        for (int height = right.blackHeight; child && (child->color == RED || height > left.blackHeight); child = child->left){
+            height -= child->color == BLACK;
+            child->quantityLeftNodes += left.size + 1;
+            parent = child;
+        }
+        node->left = left.root;
+        node->right = child;
+        node->quantityLeftNodes = left.size;
+        parent->left = node;
+        joined.root = right.root;
+        joined.blackHeight = right.blackHeight;
+    } else {
+        node->left = left.root;
+        node->right = right.root;
+        node->quantityLeftNodes = left.size;
+        joined.root = node;
+        joined.blackHeight = left.blackHeight;
+    }
+
+    node->parent = parent;
+    if (node->left)
+        node->left->parent = node;
+    if (node->right)
+        node->right->parent = node;
+
+    if (parent){
+        FixDoubleRed(node);
+        // Rotations move the root at most one level down
+        if (joined.root->parent)
+            joined.root = joined.root->parent;
+    }
+    return joined;
+}
+
+/**
+ * Join the subtrees without a node between them, the maximal node 
+ * of the left subtree becomes the middle node
+ * 
+ * @param  {Subtree} left  : Subtree with the smaller keys
+ * @param  {Subtree} right : Subtree with the greater keys
+ * @return {Subtree}       : Joined subtree
+ */
+template <class Key, class Value, class Compare>
+typename RedBlackTree<Key, Value, Compare>::Subtree RedBlackTree<Key, Value, Compare>::Concatenate(Subtree left, Subtree right) 
+{
+    if (!left.root)
+        return right;
+    if (!right.root)
+        return left;
+
+    Subtree rest;
+    NodeType* last = SplitLast(left, rest);
+    return JoinSubtrees(rest, last, right);
+}
+
+/**
+ * Split the subtree to the keys less and greater than the key
+ * 
+ * @param  {Subtree} tree  : Split subtree
+ * @param  {Key} key       : Key of the split
+ * @param  {Subtree} left  : Subtree of the smaller keys
+ * @param  {Subtree} right : Subtree of the greater keys
+ * @return {Node*}         : Detached node with the key, null if it is not there
+ */
+template <class Key, class Value, class Compare>
+Node<Key, Value>* RedBlackTree<Key, Value, Compare>::SplitSubtree(Subtree tree, const Key& key, Subtree& left, Subtree& right) 
+{
+    if (!tree.root){
+        left = right = tree;
+        return nullptr;
+    }
+
+    Subtree leftChild, rightChild, middle;
+    NodeType* node = nullptr;
+    Expose(tree, leftChild, rightChild);
+
+    if (Less(key, tree.root->key)){
+        node = SplitSubtree(leftChild, key, left, middle);
+        right = JoinSubtrees(middle, tree.root, rightChild);
+    } else if (Less(tree.root->key, key)){
+        node = SplitSubtree(rightChild, key, middle, right);
+        left = JoinSubtrees(leftChild, tree.root, middle);
+    } else {
+        left = leftChild;
+        right = rightChild;
+        node = tree.root;
+    }
+    return node;
+}
+
+/**
+ * Split the subtree to its k minimal keys and the others
+ * 
+ * @param  {Subtree} tree  : Split subtree
+ * @param  {int} k         : Number of keys of the left subtree
+ * @param  {Subtree} left  : Subtree of the k minimal keys
+ * @param  {Subtree} right : Subtree of the other keys
+ */
+template <class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::SplitSubtreeAtRank(Subtree tree, int k, Subtree& left, Subtree& right) 
+{
+    if (!tree.root){
+        left = right = tree;
+        return;
+    }
+
+    Subtree leftChild, rightChild, middle;
+    int quantityLeftNodes = tree.root->quantityLeftNodes;
+    Expose(tree, leftChild, rightChild);
+
+    if (k <= quantityLeftNodes){
+        SplitSubtreeAtRank(leftChild, k, left, middle);
+        right = JoinSubtrees(middle, tree.root, rightChild);
+    } else {
+        SplitSubtreeAtRank(rightChild, k - quantityLeftNodes - 1, middle, right);
+        left = JoinSubtrees(leftChild, tree.root, middle);
+    }
+}
+
+/**
+ * Detach the maximal node of the subtree
+ * 
+ * @param  {Subtree} tree : Non-empty subtree
+ * @param  {Subtree} rest : Subtree without the maximal node
+ * @return {Node*}        : Detached maximal node
+ */
+template <class Key, class Value, class Compare>
+Node<Key, Value>* RedBlackTree<Key, Value, Compare>::SplitLast(Subtree tree, Subtree& rest) 
+{
+    Subtree leftChild, rightChild;
+    Expose(tree, leftChild, rightChild);
+
+    if (!rightChild.root){
+        rest = leftChild;
+        return tree.root;
+    }
+
+    Subtree middle;
+    NodeType* last = SplitLast(rightChild, middle);
+    rest = JoinSubtrees(leftChild, tree.root, middle);
+    return last;
+}
+
+/**
+ * Union, intersection or difference of the subtrees by divide and conquer: 
+ * the second subtree is split by the root of the first one and the halves 
+ * are combined independently, large halves by another thread.
+ * Nodes dropped from the result are collected and released later by the caller.
+ * 
+ * @param  {Subtree} a                      : First subtree, its nodes are kept for the common keys
+ * @param  {Subtree} b                      : Second subtree
+ * @param  {SetOperation} operation         : Union, intersection or difference
+ * @param  {int} threads                    : Number of threads for the subtrees
+ * @param  {std::vector<Node*>} garbage     : Roots of the dropped subtrees
+ * @return {Subtree}                        : Result of the operation
+ */
+template <class Key, class Value, class Compare>
+typename RedBlackTree<Key, Value, Compare>::Subtree RedBlackTree<Key, Value, Compare>::Combine(Subtree a, Subtree b, SetOperation operation, 
+                                                                                                int threads, std::vector<NodeType*>& garbage) 
+{
+    if (!a.root || !b.root){
+        Subtree empty = {nullptr, 0, 0};
+        if (operation == UNION)
+            return a.root? a : b;
+        if (operation == INTERSECTION && a.root)
+            garbage.push_back(a.root);
+        if (b.root)
+            garbage.push_back(b.root);
+        return operation == DIFFERENCE? a : empty;
+    }
+
+    NodeType* node = a.root;
+    Subtree aLeft, aRight, bLeft, bRight, left, right;
+    Expose(a, aLeft, aRight);
+    NodeType* common = SplitSubtree(b, node->key, bLeft, bRight);
+    if (common)
+        garbage.push_back(common);
+
+    if (threads > 1 && a.size + b.size >= parallelSize){
+        std::vector<NodeType*> leftGarbage;
+        std::thread worker([&]{ 
+            left = Combine(aLeft, bLeft, operation, threads / 2, leftGarbage); 
+        });
+        right = Combine(aRight, bRight, operation, threads - threads / 2, garbage);
+        worker.join();
+        garbage.insert(garbage.end(), leftGarbage.begin(), leftGarbage.end());
+    } else {
+        left = Combine(aLeft, bLeft, operation, 1, garbage);
+        right = Combine(aRight, bRight, operation, 1, garbage);
+    }
+
+    if (operation == UNION || (operation == INTERSECTION) == (common != nullptr))
+        return JoinSubtrees(left, node, right);
+
+    garbage.push_back(node);
+    return Concatenate(left, right);
+}
+
+/**
+ * Release all nodes of the detached subtrees to the pool
+ * 
+ * @param  {std::vector<Node*>} roots : Roots of the subtrees
+ */
+template <class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::ReleaseSubtrees(const std::vector<NodeType*>& roots) 
+{
+    std::vector<NodeType*> stack(roots);
+
+    while (!stack.empty()){
+        NodeType* node = stack.back();
+        stack.pop_back();
+        if (node->left)
+            stack.push_back(node->left);
+        if (node->right)
+            stack.push_back(node->right);
+        pool.Release(node);
+    }
+}
+
+/**
+ * Call destructors of all nodes, the memory stays in the pool
+ * 
+ */
+template <class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::DestroyNodes() 
+{
+    NodeType* node = head;
+
+    while (node) {
+        NodeType* next;
+        if (node->right) {
+            next = node->right;
+            node->right = nullptr;
+        } else if (node->left) {
+            next = node->left;
+            node->left = nullptr;
+        } else {
+            next = node->parent;
+            node->~NodeType();
+        }
+        node = next;
+    }
+}
+
 /**
  * Print all nodes of the tree
  * 
  */
-void RedBlackTree::Print() 
+template <class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::Print() 
 {
     PrintNode(this->head);
 }
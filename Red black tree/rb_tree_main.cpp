@@ -1,24 +1,53 @@
 #include "rb_tree_test.h"
 
+// Consecutive F queries are answered together by one batch
+void FlushQueries(RedBlackTree<int>& t, vector<int>& ranks)
+{
+    vector<int> kmins(ranks.size());
+
+    t.KMinBatch(ranks.data(), ranks.size(), kmins.data());
+    for (int kmin : kmins)
+        cout << kmin << '\n';
+    ranks.clear();
+}
+
+// Consecutive I and D operations are applied together by one batch
+void FlushUpdates(RedBlackTree<int>& t, vector<RedBlackTree<int>::BatchOperation>& updates)
+{
+    t.ApplyBatch(updates.data(), updates.size());
+    updates.clear();
+}
+
 int main(int argc, char const *argv[])
 {
-    RedBlackTree t;
+    RedBlackTree<int> t;
     string operation;
     int value;
+    vector<int> ranks;
+    vector<RedBlackTree<int>::BatchOperation> updates;
+    const size_t batchSize = 1 << 16;
 
     while (cin >> operation >> value)
     {
-        if (operation == "I")
-            t.Insert(value);
-        else if (operation == "F")
-            cout << t.KMin(value) << endl;
-        else if (operation == "D")
-            t.Delete(value);
+        if (operation == "F"){
+            FlushUpdates(t, updates);
+            ranks.push_back(value);
+            continue;
+        }
+        FlushQueries(t, ranks);
+
+        if (operation == "I" || operation == "D")
+            updates.push_back({value, operation == "I"});
         else
         {
             cout << "Invalid input" << endl;
             return 1;
         }
+
+        if (updates.size() == batchSize)
+            FlushUpdates(t, updates);
     }
+    FlushUpdates(t, updates);
+    FlushQueries(t, ranks);
     return 0;
-}
\ No newline at end of file
+}
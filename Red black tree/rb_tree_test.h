@@ -2,10 +2,17 @@
 #define __RB_TREE_TEST_H__
 
 #include "rb_tree.h"
+#include "compact_rb_tree.h"
+#include "persistent_rb_tree.h"
 #include<iostream>
 #include <string>
 #include <cstdlib>
 #include <utility>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 
 using namespace std;
 
@@ -24,18 +31,33 @@ void assert(const char* expr_str, const char* file, int line, bool expr, const s
 class RedBlackTreeTester
 {
 public:
-    void TestColor(Node* node);
-    int TestNumberOfBlackNodes(Node* head);
-    void TestIntegrity(Node* node, int min, int max);
+    void TestColor(Node<int>* node);
+    int TestNumberOfBlackNodes(Node<int>* head);
+    void TestIntegrity(Node<int>* node, int min, int max);
     void TestKthMinSequence(int length);
 
     void TestSequence(int length);
     void TestRandomSequence(int length, int randSeed);
     void TestRandomPermutation(int length, int randSeed);
+    void TestClear(int length, int randSeed);
+    void TestHintInsert(int length, int randSeed);
+    void TestValues(int length, int randSeed);
+    void TestBuildFromSorted(int length, int threads);
+    void TestSplitJoin(int length, int randSeed);
+    void TestSetOperations(int length, int randSeed, int threads);
+    void TestRangeQueries(int length, int randSeed);
+    void TestBatches(int length, int randSeed);
+    void TestCompactTree(int length, int randSeed);
+    void TestFrozenTree(int length, int randSeed);
+    void TestPersistentTree(int length, int randSeed, int threads);
+    void TestApplyBatch(int length, int randSeed, int threads);
     RedBlackTreeTester();
     ~RedBlackTreeTester();
 private:
-    string KeyToString(Node* node);
+    int TestCompactNode(CompactRedBlackTree<int>& tree, uint32_t node, int min, int max);
+    int TestPersistentNode(const PersistentRedBlackTree<int>::PersistentNode* node, int min, int max);
+    void TestKeys(RedBlackTree<int>& tree, const vector<bool>& keys, const string& name);
+    string KeyToString(Node<int>* node);
     vector<int> GenerateRandomSequence(int length);
     vector<int> GenerateRandomPermutation(int length);
 };
@@ -44,7 +66,7 @@ private:
  * 
  * @param  {Node*} node : Tested node
  */
-void RedBlackTreeTester::TestColor(Node* node) 
+void RedBlackTreeTester::TestColor(Node<int>* node) 
 {
     if (!node)
         return;
@@ -73,7 +95,7 @@ void RedBlackTreeTester::TestColor(Node* node)
  * @param  {int} depth  : Number of GetParent()'s black nodes 
  * @return {int}        : New number of the black nodes during the path
  */
-int RedBlackTreeTester::TestNumberOfBlackNodes(Node* node) 
+int RedBlackTreeTester::TestNumberOfBlackNodes(Node<int>* node) 
 {
     int leftDepth = 0, rightDepth = 0, isBlack = 0;
 
@@ -103,7 +125,7 @@ int RedBlackTreeTester::TestNumberOfBlackNodes(Node* node)
  */
 void RedBlackTreeTester::TestSequence(int length) 
 {
-    RedBlackTree tree;
+    RedBlackTree<int> tree;
 
     for (int i = 2; i < length; i+=2){
         tree.Insert(i);
@@ -126,7 +148,7 @@ void RedBlackTreeTester::TestSequence(int length)
  * @param  {int} min    : Minimum key
  * @param  {int} max    : Maximum key
  */
-void RedBlackTreeTester::TestIntegrity(Node* node, int min, int max) 
+void RedBlackTreeTester::TestIntegrity(Node<int>* node, int min, int max) 
 {
     if(!node)
         return;
@@ -162,7 +184,7 @@ void RedBlackTreeTester::TestIntegrity(Node* node, int min, int max)
 
 void RedBlackTreeTester::TestKthMinSequence(int length) 
 {
-    RedBlackTree tree;
+    RedBlackTree<int> tree;
     int current = 0;
 
     for (int i = 2; i < length; i+=2)
@@ -183,6 +205,12 @@ void RedBlackTreeTester::TestKthMinSequence(int length)
         TEST(i == current, "incorect " + to_string(k) + "th min, expected " +
                 to_string(i) + ", current " + to_string(current));
     }
+
+    // Ranks below 1 are out of range like the ranks above the size
+    for (int k : {0, -1}){
+        TEST(tree.KMin(k) == INT32_MAX, "incorect " + to_string(k) + "th min, expected the maximal key");
+        TEST(RedBlackTree<int>().KMin(k) == INT32_MAX, "incorect " + to_string(k) + "th min of the empty tree");
+    }
 }
 
 /**
@@ -196,7 +224,7 @@ void RedBlackTreeTester::TestRandomSequence(int length, int randSeed)
 {
     srand(randSeed);
     vector<int> sequence = GenerateRandomSequence(length);
-    RedBlackTree tree;
+    RedBlackTree<int> tree;
 
     for (int key : sequence)
     {
@@ -225,7 +253,7 @@ void RedBlackTreeTester::TestRandomPermutation(int length, int randSeed)
 {
     srand(randSeed);
     vector<int> permutation = GenerateRandomPermutation(length);
-    RedBlackTree tree;
+    RedBlackTree<int> tree;
 
     for (int key : permutation)
     {
@@ -252,6 +280,630 @@ void RedBlackTreeTester::TestRandomPermutation(int length, int randSeed)
     }  
 }
 
+/**
+ * Test reusing of the deleted nodes and the tree after Clear()
+ * 
+ * @param  {int} length   : Length of the sequence
+ * @param  {int} randSeed : Random seed
+ */
+void RedBlackTreeTester::TestClear(int length, int randSeed) 
+{
+    srand(randSeed);
+    vector<int> permutation = GenerateRandomPermutation(length);
+    RedBlackTree<int> tree;
+
+    for (int round = 0; round < 3; round++)
+    {
+        for (int key : permutation)
+            tree.Insert(key);
+
+        // Deleted nodes are reused by the next insertions
+        for (int i = 0; i < length; i += 2)
+            tree.Delete(permutation[i]);
+        for (int i = 0; i < length; i += 2)
+            tree.Insert(permutation[i]);
+
+        TestIntegrity(tree.Head(), 0, length);
+        TestNumberOfBlackNodes(tree.Head());
+        for (int i = 1; i <= length; i++)
+            TEST(tree.KMin(i) == i - 1, "incorect " + to_string(i) + "th min after reusing the nodes");
+
+        tree.Clear();
+        TEST(tree.Head() == nullptr, "tree is not empty after clear");
+        TEST(!tree.Find(permutation[0]), to_string(permutation[0]) + " key: found after clear");
+    }
+}
+
+/**
+ * Test Insert with the hint on ascending, descending and random keys
+ * 
+ * @param  {int} length   : Length of the sequence
+ * @param  {int} randSeed : Random seed
+ */
+void RedBlackTreeTester::TestHintInsert(int length, int randSeed) 
+{
+    srand(randSeed);
+    RedBlackTree<int> ascending, descending, random;
+    Node<int>* hint = nullptr;
+
+    for (int i = 0; i < length; i++){
+        pair<Node<int>*, bool> result = ascending.Insert(hint, i);
+        TEST(result.second && result.first->key == i, to_string(i) + " key: not inserted");
+        hint = result.first;
+    }
+    for (int i = length - 1; i >= 0; i--)
+        hint = descending.Insert(hint, i).first;
+
+    // Hints far from the keys and duplicates
+    vector<bool> inserted(length, false);
+    for (int key : GenerateRandomSequence(length)){
+        pair<Node<int>*, bool> result = random.Insert(hint, key);
+        TEST(result.first->key == key, to_string(key) + " key: wrong node returned");
+        TEST(result.second != inserted[key], to_string(key) + " key: wrong inserted flag");
+        TEST(random.Insert(key).first == result.first, to_string(key) + " key: duplicate inserted");
+        inserted[key] = true;
+        hint = rand() % 2? result.first : random.Head();
+    }
+
+    for (RedBlackTree<int>* tree : {&ascending, &descending, &random}){
+        TestIntegrity(tree->Head(), 0, length);
+        TestNumberOfBlackNodes(tree->Head());
+    }
+    for (int i = 1; i <= length; i++){
+        TEST(ascending.KMin(i) == i - 1, "incorect " + to_string(i) + "th min after ascending insertions");
+        TEST(descending.KMin(i) == i - 1, "incorect " + to_string(i) + "th min after descending insertions");
+    }
+
+    for (int i = 0; i < length; i += 3)
+        random.Delete(i);
+    int previous = -1;
+    for (int k = 1; random.KMin(k) != INT32_MAX; k++){
+        int current = random.KMin(k);
+        TEST(previous < current && current % 3 != 0, "incorect " + to_string(k) + "th min after deletions");
+        previous = current;
+    }
+}
+
+/**
+ * Test values stored in the nodes, move-only values and the custom comparator
+ * 
+ * @param  {int} length   : Length of the sequence
+ * @param  {int} randSeed : Random seed
+ */
+void RedBlackTreeTester::TestValues(int length, int randSeed) 
+{
+    srand(randSeed);
+    vector<int> permutation = GenerateRandomPermutation(length);
+    RedBlackTree<string, string> names;
+    RedBlackTree<int, unique_ptr<int>, greater<int>> descending;
+
+    for (int key : permutation){
+        TEST(names.Emplace(to_string(key), "value " + to_string(key)).second, to_string(key) + " key: not inserted");
+        TEST(descending.Emplace(key, new int(2 * key)).second, to_string(key) + " key: not inserted");
+    }
+    TEST(!names.Emplace(to_string(permutation[0]), "duplicate").second, "duplicate key inserted");
+    TEST(*names.Get(to_string(permutation[0])) == "value " + to_string(permutation[0]), "duplicate changed the value");
+
+    // Deleting nodes with two children moves the successor's value
+    for (int i = 0; i < length; i += 2){
+        names.Delete(to_string(permutation[i]));
+        descending.Delete(permutation[i]);
+    }
+
+    for (int i = 0; i < length; i++){
+        string* name = names.Get(to_string(permutation[i]));
+        unique_ptr<int>* number = descending.Get(permutation[i]);
+        TEST((name != nullptr) == (i % 2 == 1), to_string(permutation[i]) + " key: wrong presence");
+        TEST((number != nullptr) == (i % 2 == 1), to_string(permutation[i]) + " key: wrong presence");
+        if (name){
+            TEST(*name == "value " + to_string(permutation[i]), to_string(permutation[i]) + " key: wrong value");
+            TEST(**number == 2 * permutation[i], to_string(permutation[i]) + " key: wrong value");
+        }
+    }
+
+    // Deleting the predecessor keeps the node, the iterator and the value of the next key
+    RedBlackTree<int, int> handles;
+    for (int key : permutation)
+        handles.Emplace(key, key);
+    for (int i = 0; i < length; i += 2){
+        RedBlackTree<int, int>::Iterator next = handles.UpperBound(permutation[i]);
+        Node<int, int>* node = next == handles.end()? nullptr : &*next;
+        int* value = node? handles.Get(node->key) : nullptr;
+
+        handles.Delete(permutation[i]);
+        if (node){
+            TEST(node->key == *value && handles.Get(node->key) == value, to_string(permutation[i]) + " key: next node moved by the deletion");
+            TEST(handles.LowerBound(permutation[i]) == next, to_string(permutation[i]) + " key: iterator of the next key is invalid");
+        }
+    }
+    int remaining = 0;
+    for (Node<int, int>& node : handles){
+        TEST(node.key == node.MappedValue(), to_string(node.key) + " key: wrong value after the deletions");
+        remaining++;
+    }
+    TEST(remaining == length / 2, "wrong size after the deletions");
+
+    // Keys are ordered by the comparator
+    for (int k = 1; k < length / 2; k++)
+        TEST(descending.KMin(k) > descending.KMin(k + 1), "incorect " + to_string(k) + "th min of the descending tree");
+
+    names.Clear();
+    TEST(names.Head() == nullptr && !names.Get(to_string(permutation[1])), "tree is not empty after clear");
+}
+
+/**
+ * Test trees built from sorted keys of every length up to the given one,
+ * the largest tree is built by the threads
+ * 
+ * @param  {int} length  : Maximal length of the sequence
+ * @param  {int} threads : Number of threads
+ */
+void RedBlackTreeTester::TestBuildFromSorted(int length, int threads) 
+{
+    RedBlackTree<int> tree;
+    vector<int> keys;
+
+    for (int n = 0; n <= length; n = n < length? min(length, n < 100? n + 1 : n + n / 2) : n + 1){
+        keys.clear();
+        for (int i = 0; i < n; i++)
+            keys.push_back(2 * i);
+
+        tree.BuildFromSorted(keys.begin(), keys.end(), n == length? threads : 1);
+        TestIntegrity(tree.Head(), 0, 2 * n);
+        TestNumberOfBlackNodes(tree.Head());
+        for (int i = 1; i <= n; i++)
+            TEST(tree.KMin(i) == 2 * (i - 1), "incorect " + to_string(i) + "th min of the built tree");
+        TEST(tree.KMin(n + 1) == INT32_MAX, "too many keys in the built tree");
+    }
+
+    // The built tree is updated like any other
+    for (int i = 0; i < length; i++)
+        tree.Insert(2 * i + 1);
+    for (int i = 0; i < length; i += 2)
+        tree.Delete(2 * i);
+    TestIntegrity(tree.Head(), 0, 2 * length);
+    TestNumberOfBlackNodes(tree.Head());
+    for (int i = 0; i < 2 * length; i++)
+        TEST(tree.Find(i) == (i % 4 != 0), to_string(i) + " key: wrong presence after updates");
+}
+
+/**
+ * Test splits by keys and ranks and joins of the parts and of independent trees
+ * 
+ * @param  {int} length   : Length of the sequence
+ * @param  {int} randSeed : Random seed
+ */
+void RedBlackTreeTester::TestSplitJoin(int length, int randSeed) 
+{
+    srand(randSeed);
+    RedBlackTree<int> tree, greater;
+    vector<bool> all(length, true), less(length, false), rest(length, false);
+
+    for (int key : GenerateRandomPermutation(length))
+        tree.Insert(key);
+
+    for (int split : {0, length / 3, length - 1, length}){
+        for (int i = 0; i < length; i++){
+            less[i] = i < split;
+            rest[i] = i >= split;
+        }
+
+        tree.Split(split, greater);
+        TestKeys(tree, less, "less part");
+        TestKeys(greater, rest, "greater part");
+        tree.Join(greater);
+        TestKeys(tree, all, "joined parts");
+        TestKeys(greater, vector<bool>(length, false), "joined greater part");
+
+        tree.SplitAtRank(split, greater);
+        TestKeys(tree, less, "part of the minimal keys");
+        TestKeys(greater, rest, "part of the other keys");
+        tree.Join(greater);
+        TestKeys(tree, all, "joined ranks");
+    }
+
+    // Trees of different heights from different pools
+    RedBlackTree<int> low, high;
+    for (int i = 0; i < length; i++)
+        (i < length / 10? low : high).Insert(i);
+    low.Join(high);
+    TestKeys(low, all, "joined trees");
+
+    for (int key : GenerateRandomPermutation(length))
+        if (key % 2)
+            low.Delete(key);
+    for (int i = 0; i < length; i++)
+        all[i] = i % 2 == 0;
+    TestKeys(low, all, "joined trees after deletions");
+}
+
+/**
+ * Test the union, the intersection and the difference of random trees 
+ * and updates of the results
+ * 
+ * @param  {int} length   : Length of the sequence
+ * @param  {int} randSeed : Random seed
+ * @param  {int} threads  : Number of threads
+ */
+void RedBlackTreeTester::TestSetOperations(int length, int randSeed, int threads) 
+{
+    srand(randSeed);
+    vector<int> first = GenerateRandomSequence(length), second = GenerateRandomSequence(length / 3 + 1);
+    vector<bool> inFirst(length, false), inSecond(length, false);
+
+    for (int key : first)
+        inFirst[key] = true;
+    for (int key : second)
+        inSecond[key] = true;
+
+    for (int operation = 0; operation < 3; operation++){
+        RedBlackTree<int> a, b;
+        vector<bool> expected(length);
+        for (int key : first)
+            a.Insert(key);
+        for (int key : second)
+            b.Insert(key);
+
+        for (int i = 0; i < length; i++){
+            if (operation == 0)
+                expected[i] = inFirst[i] || inSecond[i];
+            else if (operation == 1)
+                expected[i] = inFirst[i] && inSecond[i];
+            else 
+                expected[i] = inFirst[i] && !inSecond[i];
+        }
+
+        if (operation == 0)
+            a.Union(b, threads);
+        else if (operation == 1)
+            a.Intersection(b, threads);
+        else
+            a.Difference(b, threads);
+        TestKeys(a, expected, "result of the set operation " + to_string(operation));
+        TestKeys(b, vector<bool>(length, false), "argument of the set operation " + to_string(operation));
+
+        // Nodes of both trees are released to the result
+        for (int i = 0; i < length; i++){
+            if (i % 3 == 0)
+                a.Delete(i);
+            else
+                a.Insert(i);
+            expected[i] = i % 3 != 0;
+        }
+        TestKeys(a, expected, "updated result of the set operation " + to_string(operation));
+    }
+
+    // Keys of a sliding window travel between the trees, the free slots follow them
+    // and the pool stops growing with the number of the rounds
+    RedBlackTree<int> window, spare, empty;
+    int step = length / 4 + 1, rounds = 40;
+    size_t blocks = 0;
+    for (int key = 0; key < length; key++)
+        window.Insert(key);
+    for (int round = 0; round < rounds; round++){
+        int start = round * step;
+        for (int key = start + length; key < start + length + step; key++)
+            window.Insert(key);
+        window.Split(start + step, spare);
+        if (round % 2 == 0)
+            spare.Difference(window, threads);
+        else
+            window.Intersection(empty, threads);
+        window.Union(spare, threads);
+        if (round == 4)
+            blocks = window.pool.Blocks();
+    }
+    TEST(window.pool.Blocks() <= blocks + 1, "pool grows with the number of the set operations");
+
+    vector<bool> expected(rounds * step + length, false);
+    for (int key = rounds * step; key < rounds * step + length; key++)
+        expected[key] = true;
+    TestKeys(window, expected, "sliding window after the set operations");
+}
+
+/**
+ * Test iterations, bounds, ranks and counts of ranges against the sorted keys
+ * 
+ * @param  {int} length   : Length of the sequence
+ * @param  {int} randSeed : Random seed
+ */
+void RedBlackTreeTester::TestRangeQueries(int length, int randSeed) 
+{
+    srand(randSeed);
+    RedBlackTree<int> tree;
+    vector<int> sorted;
+    vector<int> less(2 * length + 2, 0);
+
+    for (int key : GenerateRandomSequence(length))
+        tree.Insert(2 * key);
+    for (int key = 0; key < 2 * length; key += 2)
+        if (tree.Find(key))
+            sorted.push_back(key);
+
+    // less[key + 1] is the number of keys less than key
+    for (int key : sorted)
+        less[key + 2]++;
+    for (size_t i = 1; i < less.size(); i++)
+        less[i] += less[i - 1];
+
+    vector<int> forward, backward;
+    for (Node<int>& node : tree)
+        forward.push_back(node.key);
+    for (RedBlackTree<int>::Iterator it = tree.end(); it != tree.begin(); )
+        backward.insert(backward.begin(), (--it)->key);
+    TEST(forward == sorted, "wrong order of the forward iteration");
+    TEST(backward == sorted, "wrong order of the backward iteration");
+
+    for (int key = -1; key <= 2 * length; key++){
+        int lower = less[key + 1], upper = key % 2 == 0 && tree.Find(key)? lower + 1 : lower;
+        RedBlackTree<int>::Iterator lowerBound = tree.LowerBound(key), upperBound = tree.UpperBound(key);
+
+        TEST(lower == (int)sorted.size()? lowerBound == tree.end() : lowerBound->key == sorted[lower], 
+             to_string(key) + " key: wrong lower bound");
+        TEST(upper == (int)sorted.size()? upperBound == tree.end() : upperBound->key == sorted[upper], 
+             to_string(key) + " key: wrong upper bound");
+        TEST(tree.Rank(key) == lower + 1, to_string(key) + " key: wrong rank");
+    }
+    for (int k = 1; k <= (int)sorted.size(); k++)
+        TEST(tree.Rank(tree.KMin(k)) == k, "rank of the " + to_string(k) + "th min is not k");
+
+    for (int i = 0; i < length; i++){
+        int low = rand() % (2 * length + 1) - 1, high = rand() % (2 * length + 1) - 1;
+        int expected = 0;
+        for (RedBlackTree<int>::Iterator it = tree.LowerBound(low); it != tree.end() && it->key <= high; ++it)
+            expected++;
+        TEST(tree.CountRange(low, high) == expected, 
+             "wrong count of the keys from " + to_string(low) + " to " + to_string(high));
+        TEST(expected == (high < low? 0 : less[high + 2] - less[low + 1]), 
+             "wrong scan of the keys from " + to_string(low) + " to " + to_string(high));
+    }
+}
+
+/**
+ * Test batched searches of random and sorted keys and ranks against the single ones
+ * 
+ * @param  {int} length   : Length of the sequence
+ * @param  {int} randSeed : Random seed
+ */
+void RedBlackTreeTester::TestBatches(int length, int randSeed) 
+{
+    srand(randSeed);
+    RedBlackTree<int> tree;
+
+    for (int key : GenerateRandomSequence(length))
+        tree.Insert(key);
+
+    for (int size : {0, 1, 7, length, 3 * length}){
+        vector<int> keys, ranks;
+        for (int i = 0; i < size; i++){
+            keys.push_back(rand() % (length + 2) - 1);
+            ranks.push_back(rand() % (length + 3) - 1);
+        }
+
+        for (int sorted = 0; sorted < 2; sorted++){
+            if (sorted){
+                sort(keys.begin(), keys.end());
+                sort(ranks.begin(), ranks.end());
+            }
+
+            unique_ptr<bool[]> found(new bool[size + 1]);
+            vector<int> kmins(size + 1);
+            tree.FindBatch(keys.data(), size, found.get());
+            tree.KMinBatch(ranks.data(), size, kmins.data());
+
+            for (int i = 0; i < size; i++){
+                TEST(found[i] == tree.Find(keys[i]), to_string(keys[i]) + " key: wrong batched find");
+                TEST(kmins[i] == tree.KMin(ranks[i]), "incorect batched " + to_string(ranks[i]) + "th min");
+            }
+        }
+    }
+}
+
+/**
+ * Test the compact tree against the tree of nodes on random insertions and deletions
+ * 
+ * @param  {int} length   : Length of the sequence
+ * @param  {int} randSeed : Random seed
+ */
+void RedBlackTreeTester::TestCompactTree(int length, int randSeed) 
+{
+    srand(randSeed);
+    RedBlackTree<int> tree;
+    CompactRedBlackTree<int> compact;
+
+    for (int round = 0; round < 2; round++){
+        for (int key : GenerateRandomSequence(length))
+            TEST(compact.Insert(key) == tree.Insert(key).second, to_string(key) + " key: wrong inserted flag");
+        TestCompactNode(compact, compact.Root(), -1, length);
+
+        // Deleted nodes are reused by the next round
+        for (int key : GenerateRandomSequence(length)){
+            compact.Delete(key);
+            tree.Delete(key);
+        }
+        TestCompactNode(compact, compact.Root(), -1, length);
+
+        for (int i = 0; i < length; i++)
+            TEST(compact.Find(i) == tree.Find(i), to_string(i) + " key: wrong presence in the compact tree");
+        for (int k = 0; k <= length + 1; k++)
+            TEST(compact.KMin(k) == tree.KMin(k), "incorect " + to_string(k) + "th min of the compact tree");
+    }
+
+    compact.Clear();
+    TEST(compact.Root() == 0 && compact.Size() == 0, "compact tree is not empty after clear");
+    TEST(!compact.Find(0), "0 key: found after clear");
+}
+
+/**
+ * Test snapshots of the tree against the tree before and after update bursts
+ * 
+ * @param  {int} length   : Length of the sequence
+ * @param  {int} randSeed : Random seed
+ */
+void RedBlackTreeTester::TestFrozenTree(int length, int randSeed) 
+{
+    srand(randSeed);
+    RedBlackTree<int> tree;
+    FrozenRedBlackTree<int> snapshot = tree.Freeze();
+
+    TEST(snapshot.Size() == 0 && !snapshot.Find(0), "snapshot of the empty tree is not empty");
+    TEST(snapshot.KMin(1) == INT32_MAX && snapshot.Rank(0) == 1, "wrong queries of the empty snapshot");
+
+    for (int burst = 0; burst < 3; burst++){
+        for (int key : GenerateRandomSequence(length))
+            if (rand() % 3)
+                tree.Insert(2 * key);
+            else
+                tree.Delete(2 * key);
+        tree.Freeze(snapshot);
+
+        TEST(snapshot.Size() == tree.Size(), "wrong size of the snapshot");
+        TEST(reinterpret_cast<uintptr_t>(snapshot.keys.data()) % 64 == 0, "keys of the snapshot do not start at a cache line");
+        for (int key = -1; key <= 2 * length; key++){
+            TEST(snapshot.Find(key) == tree.Find(key), to_string(key) + " key: wrong presence in the snapshot");
+            TEST(snapshot.Rank(key) == tree.Rank(key), to_string(key) + " key: wrong rank in the snapshot");
+        }
+        for (int k = 0; k <= tree.Size() + 1; k++)
+            TEST(snapshot.KMin(k) == tree.KMin(k), "incorect " + to_string(k) + "th min of the snapshot");
+    }
+}
+
+/**
+ * Test versions of the persistent tree pinned during the later updates
+ * and readers running with the writer
+ * 
+ * @param  {int} length   : Range of the keys
+ * @param  {int} randSeed : Seed of the random keys
+ * @param  {int} threads  : Number of the reader threads
+ */
+void RedBlackTreeTester::TestPersistentTree(int length, int randSeed, int threads) 
+{
+    srand(randSeed);
+    PersistentRedBlackTree<int> tree(3);
+    RedBlackTree<int> expected;
+    vector<PersistentRedBlackTree<int>::Snapshot> versions;
+    vector<vector<int>> versionKeys;
+
+    for (int burst = 0; burst < 3; burst++){
+        for (int key : GenerateRandomSequence(length)){
+            if (rand() % 3){
+                TEST(tree.Insert(key) == expected.Insert(key).second, to_string(key) + " key: wrong inserted flag");
+            } else {
+                tree.Delete(key);
+                expected.Delete(key);
+            }
+        }
+        versions.push_back(tree.Read(burst));
+        versionKeys.push_back(vector<int>());
+        for (Node<int>& node : expected)
+            versionKeys.back().push_back(node.key);
+        TestPersistentNode(versions.back().Root(), -1, length);
+    }
+
+    for (size_t i = 0; i < versions.size(); i++){
+        TEST(versions[i].Size() == int(versionKeys[i].size()), "wrong size of the version " + to_string(i));
+        for (int key = -1; key <= length; key++)
+            TEST(versions[i].Find(key) == binary_search(versionKeys[i].begin(), versionKeys[i].end(), key), 
+                 to_string(key) + " key: wrong presence in the version " + to_string(i));
+        for (int k = 0; k <= versions[i].Size() + 1; k++)
+            TEST(versions[i].KMin(k) == (k >= 1 && k <= versions[i].Size()? versionKeys[i][k - 1] : INT32_MAX), 
+                 "incorect " + to_string(k) + "th min of the version " + to_string(i));
+    }
+
+    // A busy slot keeps its epoch, another snapshot in it would unpin the version
+    bool thrown = false;
+    try {
+        tree.Read(0);
+    } catch (const logic_error&) {
+        thrown = true;
+    }
+    TEST(thrown, "second snapshot in a busy reader slot");
+    tree.Insert(length);
+    tree.Delete(length);
+    TEST(versions[0].Size() == int(versionKeys[0].size()), "version changed after the rejected read");
+    for (int key : versionKeys[0])
+        TEST(versions[0].Find(key), to_string(key) + " key: lost by the version after the rejected read");
+
+    // Nodes of the released versions are freed by the next updates
+    versions.clear();
+    for (int key = 0; key < length; key++)
+        tree.Delete(key);
+    TEST(tree.Read(0).Size() == 0 && !tree.Read(1).Find(0), "persistent tree is not empty after deletions");
+
+    // The writer inserts and then deletes ascending keys, so every version is a range of keys
+    PersistentRedBlackTree<int> window(threads);
+    atomic<bool> done(false);
+    vector<thread> readers;
+
+    for (int reader = 0; reader < threads; reader++){
+        readers.emplace_back([&window, &done, reader](){
+            while (!done.load()){
+                PersistentRedBlackTree<int>::Snapshot snapshot = window.Read(reader);
+                int size = snapshot.Size();
+                if (size == 0)
+                    continue;
+                int first = snapshot.KMin(1);
+                TEST(snapshot.KMin(size) == first + size - 1, "keys of the read version are not a range");
+                TEST(snapshot.Find(first + size / 2), "middle key of the read version is not found");
+                TEST(!snapshot.Find(first - 1) && !snapshot.Find(first + size), "key out of the read version is found");
+            }
+        });
+    }
+    for (int key = 0; key < length; key++)
+        window.Insert(key);
+    for (int key = 0; key < length; key++)
+        window.Delete(key);
+    done.store(true);
+    for (thread& reader : readers)
+        reader.join();
+}
+
+/**
+ * Test batches of insertions and deletions with repeated keys
+ * 
+ * @param  {int} length   : Range of the keys and size of the batches
+ * @param  {int} randSeed : Seed of the random operations
+ * @param  {int} threads  : Number of threads applying the batches
+ */
+void RedBlackTreeTester::TestApplyBatch(int length, int randSeed, int threads) 
+{
+    srand(randSeed);
+    RedBlackTree<int> tree;
+    vector<bool> expected(length, false);
+
+    for (int round = 0; round < 4; round++){
+        // Only the last operation of a key counts
+        vector<RedBlackTree<int>::BatchOperation> batch;
+        for (int i = 0; i < length; i++){
+            int key = rand() % length;
+            bool insert = round == 0 || rand() % 2;
+            batch.push_back({key, insert});
+            expected[key] = insert;
+        }
+
+        tree.ApplyBatch(batch.data(), batch.size(), threads);
+        TestKeys(tree, expected, "tree after the batch " + to_string(round));
+    }
+
+    tree.ApplyBatch(nullptr, 0, threads);
+    TestKeys(tree, expected, "tree after the empty batch");
+
+    // Slots of the deleted keys are reused, the pool stops growing with the number of the keys
+    size_t blocks = 0;
+    for (int round = 0; round < 40; round++){
+        vector<RedBlackTree<int>::BatchOperation> batch;
+        for (int i = 0; i < length; i++){
+            int key = rand() % length;
+            batch.push_back({key, rand() % 2 == 0});
+            expected[key] = batch.back().insert;
+        }
+        tree.ApplyBatch(batch.data(), batch.size(), threads);
+        if (round == 4)
+            blocks = tree.pool.Blocks();
+    }
+    TEST(tree.pool.Blocks() <= blocks + 1, "pool grows with the number of the batches");
+    TestKeys(tree, expected, "tree after the churn");
+}
 RedBlackTreeTester::RedBlackTreeTester()
 {
 }
@@ -260,7 +912,91 @@ RedBlackTreeTester::~RedBlackTreeTester()
 {
 }
 
-string RedBlackTreeTester::KeyToString(Node* node) 
+/**
+ * Test order, colors, black heights and sizes of the persistent subtree
+ * 
+ * @param  {PersistentNode*} node : Root of the subtree
+ * @param  {int} min              : Keys of the subtree are greater
+ * @param  {int} max              : Keys of the subtree are less
+ * @return {int}                  : Number of black nodes on the paths to the leaves
+ */
+int RedBlackTreeTester::TestPersistentNode(const PersistentRedBlackTree<int>::PersistentNode* node, int min, int max) 
+{
+    if (!node)
+        return 1;
+
+    int key = node->key;
+    int leftSize = node->left? node->left->size : 0, rightSize = node->right? node->right->size : 0;
+
+    TEST(key > min && key < max, to_string(key) + " key: out of order in the persistent tree");
+    TEST(node->quantityLeftNodes == leftSize && node->size == leftSize + 1 + rightSize, 
+         to_string(key) + " key: wrong size in the persistent tree");
+    TEST(node->color == BLACK || ((!node->left || node->left->color == BLACK) && (!node->right || node->right->color == BLACK)), 
+         to_string(key) + " key: red node with the red child in the persistent tree");
+
+    int left = TestPersistentNode(node->left, min, key);
+    int right = TestPersistentNode(node->right, key, max);
+    TEST(left == right, to_string(key) + " key: different black heights in the persistent tree");
+
+    return left + (node->color == BLACK);
+}
+/**
+ * Test links, colors and the order of the compact subtree 
+ * 
+ * @param  {CompactRedBlackTree} tree : Tested tree
+ * @param  {uint32_t} node            : Root of the subtree
+ * @param  {int} min                  : Keys are greater
+ * @param  {int} max                  : Keys are less
+ * @return {int}                      : Number of black nodes on every path down
+ */
+int RedBlackTreeTester::TestCompactNode(CompactRedBlackTree<int>& tree, uint32_t node, int min, int max) 
+{
+    if (node == 0)
+        return 1;
+
+    int key = tree.KeyOf(node);
+    uint32_t children[] = {tree.LeftChild(node), tree.RightChild(node)};
+
+    TEST(key > min && key < max, to_string(key) + " key: out of order in the compact tree");
+    for (uint32_t child : children){
+        if (child == 0)
+            continue;
+        TEST(tree.Parent(child) == node, to_string(key) + " key: wrong parent of the child in the compact tree");
+        TEST(tree.Color(node) == BLACK || tree.Color(child) == BLACK, 
+             to_string(key) + " key: red node with the red child in the compact tree");
+    }
+
+    int left = TestCompactNode(tree, children[0], min, key);
+    int right = TestCompactNode(tree, children[1], key, max);
+    TEST(left == right, to_string(key) + " key: different black heights in the compact tree");
+
+    return left + (tree.Color(node) == BLACK);
+}
+
+/**
+ * Test the structure of the tree and that it has exactly the given keys
+ * 
+ * @param  {RedBlackTree} tree         : Tested tree
+ * @param  {std::vector<bool>} keys    : True for the keys in the tree
+ * @param  {string} name               : Name of the tree in the messages
+ */
+void RedBlackTreeTester::TestKeys(RedBlackTree<int>& tree, const vector<bool>& keys, const string& name) 
+{
+    TestIntegrity(tree.Head(), 0, keys.size());
+    TestNumberOfBlackNodes(tree.Head());
+
+    int k = 0;
+    for (int i = 0; i < (int)keys.size(); i++){
+        TEST(tree.Find(i) == keys[i], to_string(i) + " key: wrong presence in the " + name);
+        if (keys[i]){
+            k++;
+            TEST(tree.KMin(k) == i, "incorect " + to_string(k) + "th min of the " + name);
+        }
+    }
+    TEST(tree.KMin(k + 1) == INT32_MAX, "too many keys in the " + name);
+}
+
+string RedBlackTreeTester::KeyToString(Node<int>* node) 
 {
     return node? to_string(node->key) : "null";
 }
@@ -285,7 +1021,7 @@ vector<int> RedBlackTreeTester::GenerateRandomPermutation(int length)
     }
     
     for (int i = 0; i < length; i++)
-        swap(per[i], per[(i + rand()) % length]);
+        swap(per[i], per[i + rand() % (length - i)]);
     
     return per;
 }